@@ -19,25 +19,42 @@
 * monte carlo?
 */
 
+#include <algorithm>
 #include <array>
-#include <bitset>
+#include <atomic>
+#include <bit>
 #include <chrono>
+#include <climits>
 #include <cmath>
 #include <concepts>
 #include <fstream>
 #include <format>
-#include <functional>
 #include <iostream>
 #include <iterator>
 #include <list>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <thread>
 #include <time.h>
 #include <vector>
 #include <set>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <SDL.h>
 
 class SDLContext {
@@ -53,6 +70,10 @@ public:
 			throw "couldn't create window";
 		}
 		SDLRenderer = SDL_CreateRenderer(SDLWindow, -1, SDL_RENDERER_ACCELERATED);
+		if (SDLRenderer == NULL)
+			SDLRenderer = SDL_CreateRenderer(SDLWindow, -1, SDL_RENDERER_SOFTWARE);
+		if (SDLRenderer == NULL)
+			throw "couldn't create renderer";
 		SDL_RenderSetLogicalSize(SDLRenderer, width, height);
 		SDL_SetRenderDrawBlendMode(SDLRenderer, SDL_BLENDMODE_BLEND);
 	}
@@ -68,6 +89,10 @@ public:
 		return SDLRenderer;
 	}
 
+	void setTitle(const std::string& title) {
+		SDL_SetWindowTitle(SDLWindow, title.c_str());
+	}
+
 public:
 	const int width;
 	const int height;
@@ -78,542 +103,3183 @@ private:
 	SDL_Renderer* SDLRenderer;
 };
 
-enum class VerticalDirection {
-	down = -1,
-	flat = 0,
-	up = 1
-};
-
-enum class TraversalState {
+enum class TraversalState : uint8_t {
 	undiscovered,
 	discovered,
 	processed
 };
 
-class Cell {
+// Cells are identified by their index into the grid: x + width * (y + height * z).
+// Coordinates are derived from the index rather than stored.
+using CellIndex = uint32_t;
+static constexpr CellIndex noCell = UINT32_MAX;
+
+// xoshiro256** pseudo random generator. Each Random owns its state, so generators on different threads don't interfere,
+// and the same seed always produces the same sequence on every platform.
+class Random {
+public:
+	explicit Random(uint64_t seed) {
+		// expand the seed with splitmix64 so that similar seeds still give unrelated streams
+		for (uint64_t& word : state) {
+			seed += 0x9e3779b97f4a7c15ull;
+			uint64_t z = seed;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+			word = z ^ (z >> 31);
+		}
+	}
+
+	uint64_t next() {
+		const uint64_t result = rotl(state[1] * 5, 7) * 9;
+		const uint64_t t = state[1] << 17;
+		state[2] ^= state[0];
+		state[3] ^= state[1];
+		state[1] ^= state[2];
+		state[0] ^= state[3];
+		state[2] ^= t;
+		state[3] = rotl(state[3], 45);
+		return result;
+	}
+
+	// uniform in [0, bound)
+	uint32_t below(uint32_t bound) {
+		// multiply-shift instead of modulo; the bias is below 2^-32 for any bound we use
+		return static_cast<uint32_t>(((next() >> 32) * bound) >> 32);
+	}
+
+	// probabilities are turned into integer thresholds once, so each check is a single compare
+	using Threshold = uint64_t;
+	static Threshold threshold(double probability) {
+		if (probability <= 0)
+			return 0;
+		if (probability >= 1)
+			return 1ull << 32;
+		return static_cast<Threshold>(probability * 4294967296.0);
+	}
+	bool chance(Threshold threshold) { return (next() >> 32) < threshold; }
+
+	// Fisher-Yates, in place
+	template <typename T>
+	void shuffle(std::vector<T>& items) {
+		for (size_t i = items.size(); i > 1; i--)
+			std::swap(items[i - 1], items[below(static_cast<uint32_t>(i))]);
+	}
+
+private:
+	static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+	uint64_t state[4];
+};
+
+// Fixed-capacity FIFO over a circular buffer. Sized up front (or by reserve() while empty), so pushing and popping
+// are O(1) and never reallocate.
+template <typename T>
+class RingQueue {
+public:
+	RingQueue() : capacity(0) {}
+	explicit RingQueue(size_t capacity) : buffer(new T[capacity]), capacity(capacity) {}
+
+	// empties the queue, growing it first if it can't hold newCapacity
+	void reserve(size_t newCapacity) {
+		if (newCapacity > capacity) {
+			buffer.reset(new T[newCapacity]);
+			capacity = newCapacity;
+		}
+		clear();
+	}
+
+	bool empty() const { return count == 0; }
+	size_t size() const { return count; }
+	void clear() { head = 0; count = 0; }
+
+	void push_back(T value) {
+		if (count == capacity)
+			throw "queue overflow";
+		size_t tail = head + count;
+		if (tail >= capacity)
+			tail -= capacity;
+		buffer[tail] = value;
+		count++;
+	}
+	T pop_front() {
+		T value = buffer[head];
+		if (++head == capacity)
+			head = 0;
+		count--;
+		return value;
+	}
+
+private:
+	std::unique_ptr<T[]> buffer;
+	size_t capacity;
+	size_t head = 0;
+	size_t count = 0;
+};
+
+// Union-find over 0..count-1 with path halving. Single-threaded; carveParallelKruskal has its own lock-free version.
+template <typename T>
+class DisjointSets {
+public:
+	explicit DisjointSets(size_t count) : parents(count) {
+		for (size_t i = 0; i < count; i++)
+			parents[i] = static_cast<T>(i);
+	}
+
+	T find(T x) {
+		while (parents[x] != x)
+			x = parents[x] = parents[parents[x]];
+		return x;
+	}
+	// a and b must be roots
+	void link(T a, T b) { parents[a] = b; }
+
+private:
+	std::vector<T> parents;
+};
+
+// Monotone priority queue for integer keys: every pushed key must be at least the last popped key.
+// Entries sit in buckets by the highest bit in which they differ from the last popped key, and each entry
+// moves to a lower bucket at most 32 times, so push is O(1) and pop is amortized O(log range).
+template <typename T>
+class RadixHeap {
+public:
+	bool empty() const { return count == 0; }
+	void clear() {
+		for (auto& bucket : buckets)
+			bucket.clear();
+		last = 0;
+		count = 0;
+	}
+
+	void push(uint32_t key, T value) {
+		buckets[bucketFor(key)].push_back({ key, value });
+		count++;
+	}
+	// removes and returns an entry with the smallest key
+	T pop(uint32_t& key) {
+		if (buckets[0].empty()) {
+			size_t i = 1;
+			while (buckets[i].empty())
+				i++;
+			last = std::min_element(buckets[i].begin(), buckets[i].end(), [](const Entry& a, const Entry& b) { return a.key < b.key; })->key;
+			for (const Entry& e : buckets[i])
+				buckets[bucketFor(e.key)].push_back(e);
+			buckets[i].clear();
+		}
+		Entry e = buckets[0].back();
+		buckets[0].pop_back();
+		count--;
+		key = e.key;
+		return e.value;
+	}
+
+private:
+	struct Entry {
+		uint32_t key;
+		T value;
+	};
+
+	size_t bucketFor(uint32_t key) const { return key == last ? 0 : 32 - std::countl_zero(key ^ last); }
+
+	std::array<std::vector<Entry>, 33> buckets;
+	uint32_t last = 0;
+	size_t count = 0;
+};
+
+// BFS and DFS visitors provide any subset of these hooks; hooks a visitor doesn't have compile away entirely.
+//   earlyVertex(c)  c was taken off the queue (BFS) or entered (DFS)
+//   lateVertex(c)   all of c's connections have been seen; in a DFS, all of its subtree too
+//   edge(p, c)      connection from p to c, called before c is marked discovered
+template <typename V>
+concept HasEarlyVertex = requires(V& v, CellIndex c) { v.earlyVertex(c); };
+template <typename V>
+concept HasLateVertex = requires(V& v, CellIndex c) { v.lateVertex(c); };
+template <typename V>
+concept HasEdge = requires(V& v, CellIndex p, CellIndex c) { v.edge(p, c); };
+template <typename V>
+concept BFSVisitor = HasEarlyVertex<V> || HasLateVertex<V> || HasEdge<V>;
+
+// Placeholder for an unused hook. It isn't callable, so the matching concept above fails and the call is dropped.
+struct NoHook {};
+
+// Builds a visitor from lambdas, e.g. BFSHooks{ .lateVertex = [&](CellIndex c) { ... } }
+template <typename Early = NoHook, typename Late = NoHook, typename Edge = NoHook>
+struct BFSHooks {
+	[[no_unique_address]] Early earlyVertex{};
+	[[no_unique_address]] Late lateVertex{};
+	[[no_unique_address]] Edge edge{};
+};
+
+// Receives notifications while a Maze is being generated.
+// Maze never talks to SDL itself; anything that wants to draw (or log, or count) hooks in here.
+class MazeObserver {
+public:
+	virtual ~MazeObserver() = default;
+
+	virtual void cellChanged(CellIndex c) {} // connections or open state of c changed
+	virtual void stepFinished() {} // one carve step is complete
+	virtual void solutionChanged() {} // start and finish have been placed
+	virtual void mazeChanged() {} // any number of cells changed at once
+};
+
+// A file mapped into memory. Pages are loaded on first touch and writes stay private to this process (copy on write),
+// so a mapped maze can still be searched or modified without touching the file.
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			throw "couldn't open maze file";
+		LARGE_INTEGER fileSize;
+		GetFileSizeEx(file, &fileSize);
+		length = static_cast<size_t>(fileSize.QuadPart);
+		mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (mapping == NULL) {
+			CloseHandle(file);
+			throw "couldn't map maze file";
+		}
+		bytes = static_cast<uint8_t*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+		if (bytes == NULL) {
+			CloseHandle(mapping);
+			CloseHandle(file);
+			throw "couldn't map maze file";
+		}
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw "couldn't open maze file";
+		struct stat info;
+		fstat(fd, &info);
+		length = static_cast<size_t>(info.st_size);
+		void* address = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		close(fd); // the mapping keeps its own reference
+		if (address == MAP_FAILED)
+			throw "couldn't map maze file";
+		bytes = static_cast<uint8_t*>(address);
+#endif
+	}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile() {
+#ifdef _WIN32
+		UnmapViewOfFile(bytes);
+		CloseHandle(mapping);
+		CloseHandle(file);
+#else
+		munmap(bytes, length);
+#endif
+	}
+
+	uint8_t* data() { return bytes; }
+	size_t size() { return length; }
+
+private:
+	uint8_t* bytes;
+	size_t length;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+// On-disk maze layout (version 1, little endian):
+//   MazeFileHeader
+//   topology bytes, one per cell, in CellIndex order
+//   zero padding to an 8 byte boundary
+//   open bits, one uint64_t per 64 cells
+//   solution, solutionLength CellIndex values from start to finish
+struct MazeFileHeader {
+	static constexpr char expectedMagic[4] = { 'A', 'M', 'Z', 'E' };
+	static constexpr uint32_t currentVersion = 1;
+
+	char magic[4];
+	uint32_t version;
+	uint32_t width, height, layers;
+	uint32_t solutionLength;
+	uint64_t seed;
+
+	static size_t openBitsOffset(size_t cellCount) { return (sizeof(MazeFileHeader) + cellCount + 7) / 8 * 8; }
+	static size_t solutionOffset(size_t cellCount) { return openBitsOffset(cellCount) + (cellCount + 63) / 64 * 8; }
+};
+static_assert(sizeof(MazeFileHeader) == 32, "maze file header must not contain padding");
+
+// measures consecutive phases of work
+class Stopwatch {
+public:
+	// milliseconds since the previous lap (or construction)
+	double lap() {
+		auto now = std::chrono::steady_clock::now();
+		double ms = std::chrono::duration<double, std::milli>(now - last).count();
+		last = now;
+		return ms;
+	}
+
+private:
+	std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+};
+
+// generation chances as precomputed integer thresholds
+struct CarveChances {
+	CarveChances(double branchChance, double loopChance, double bridgeChance) :
+		branch(Random::threshold(branchChance)),
+		loop(Random::threshold(loopChance)),
+		bridge(Random::threshold(bridgeChance))
+	{}
+
+	Random::Threshold branch, loop, bridge;
+};
+
+// how generate() carves the maze
+enum class GeneratorEngine {
+	growingTree, // the original frontier algorithm - texture set by branchChance, supports bridges
+	wilson, // loop-erased random walks - a uniformly random spanning tree of the ground layer
+	kruskal, // random edge order with union-find - fast, many short dead ends
+	parallelKruskal // kruskal over a lock-free union-find, with walls split between threads
+};
+
+static constexpr GeneratorEngine allEngines[] = { GeneratorEngine::growingTree, GeneratorEngine::wilson, GeneratorEngine::kruskal, GeneratorEngine::parallelKruskal };
+
+const char* engineName(GeneratorEngine engine) {
+	switch (engine) {
+	case GeneratorEngine::growingTree:
+		return "growing";
+	case GeneratorEngine::wilson:
+		return "wilson";
+	case GeneratorEngine::kruskal:
+		return "kruskal";
+	case GeneratorEngine::parallelKruskal:
+		return "parallel-kruskal";
+	default:
+		throw "unhandled engine";
+	}
+}
+
+// throws std::invalid_argument for a name that isn't one of engineName()'s
+GeneratorEngine parseEngine(const std::string& name) {
+	for (GeneratorEngine engine : allEngines) {
+		if (name == engineName(engine))
+			return engine;
+	}
+	throw std::invalid_argument(name);
+}
+
+// how generate() picks the start and finish, which always sit at the ends of a longest shortest path
+enum class EndpointPlacement {
+	diameterSearch, // two full searches once the maze is carved
+	trackedDiameter, // kept up to date while carving; growing-tree mazes without loops only, others fall back to searching
+	boundedDiameter // searches until the diameter is pinned down to within a slack; exact with loops too, unlike the two searches,
+	                // but braided mazes take tens of searches instead of two
+};
+
+// the --endpoints names; throws std::invalid_argument for anything else
+EndpointPlacement parseEndpoints(const std::string& name) {
+	if (name == "search")
+		return EndpointPlacement::diameterSearch;
+	if (name == "track")
+		return EndpointPlacement::trackedDiameter;
+	if (name == "bound")
+		return EndpointPlacement::boundedDiameter;
+	throw std::invalid_argument(name);
+}
+
+// The two ends of a longest path through a tree that only ever grows by adding leaves, as the growing-tree carver does.
+// A longest path through a new leaf always ends at one of the current ends, so each leaf costs two distance queries.
+// Those find lowest common ancestors through skew-binary jump pointers, which take O(1) to set up per leaf
+// and reach any ancestor in O(log n) steps.
+class DiameterTracker {
 public:
-	int x{}, y{}, z{};
-	bool open{};
-	std::bitset<4> connections{};
-	std::array<VerticalDirection, 4> verticalConnections{ VerticalDirection::flat, VerticalDirection::flat, VerticalDirection::flat, VerticalDirection::flat };
-	TraversalState state{ TraversalState::undiscovered };
+	void reset(size_t cellCount, CellIndex root) {
+		nodes.assign(cellCount, { noCell, noCell, 0 });
+		nodes[root] = { root, root, 0 };
+		ends[0] = ends[1] = root;
+		length = 0;
+	}
+
+	void addLeaf(CellIndex leaf, CellIndex parent) {
+		// jump as far as the parent's jump does again if the two jumps are the same size, otherwise just to the parent
+		const Node& up = nodes[parent];
+		const Node& upJump = nodes[up.jump];
+		nodes[leaf] = { parent, up.depth - upJump.depth == upJump.depth - nodes[upJump.jump].depth ? upJump.jump : parent, up.depth + 1 };
+
+		// paths can't be longer than going via the root, which usually rules the leaf out without looking for ancestors
+		if (nodes[leaf].depth + std::max(nodes[ends[0]].depth, nodes[ends[1]].depth) <= length)
+			return;
+		uint32_t toFirst = distance(leaf, ends[0]);
+		uint32_t toSecond = distance(leaf, ends[1]);
+		if (std::max(toFirst, toSecond) <= length)
+			return;
+		if (toFirst >= toSecond) {
+			ends[1] = leaf;
+			length = toFirst;
+		} else {
+			ends[0] = leaf;
+			length = toSecond;
+		}
+	}
+
+	// the cells from one end to the other
+	std::vector<CellIndex> path() {
+		std::vector<CellIndex> cells;
+		std::vector<CellIndex> otherHalf;
+		CellIndex meeting = lowestCommonAncestor(ends[0], ends[1]);
+		for (CellIndex c = ends[0]; c != meeting; c = nodes[c].parent)
+			cells.push_back(c);
+		cells.push_back(meeting);
+		for (CellIndex c = ends[1]; c != meeting; c = nodes[c].parent)
+			otherHalf.push_back(c);
+		cells.insert(cells.end(), otherHalf.rbegin(), otherHalf.rend());
+		return cells;
+	}
+
+private:
+	// kept together so each step up the tree touches one cache line
+	struct Node {
+		CellIndex parent;
+		CellIndex jump;
+		uint32_t depth;
+	};
+
+	CellIndex ancestorAtDepth(CellIndex c, uint32_t depth) {
+		while (nodes[c].depth > depth)
+			c = nodes[nodes[c].jump].depth >= depth ? nodes[c].jump : nodes[c].parent;
+		return c;
+	}
+	CellIndex lowestCommonAncestor(CellIndex a, CellIndex b) {
+		a = ancestorAtDepth(a, nodes[b].depth);
+		b = ancestorAtDepth(b, nodes[a].depth);
+		// at equal depths both have the same jump lengths, so they can jump together until the jumps would meet
+		while (a != b) {
+			if (nodes[a].jump != nodes[b].jump) {
+				a = nodes[a].jump;
+				b = nodes[b].jump;
+			} else {
+				a = nodes[a].parent;
+				b = nodes[b].parent;
+			}
+		}
+		return a;
+	}
+	uint32_t distance(CellIndex a, CellIndex b) { return nodes[a].depth + nodes[b].depth - 2 * nodes[lowestCommonAncestor(a, b)].depth; }
+
+	std::vector<Node> nodes;
+	CellIndex ends[2] = { noCell, noCell };
+	uint32_t length = 0;
+};
+
+// half-open rectangle of ground coordinates that a carve may touch
+struct TileBounds {
+	int left, top, right, bottom;
+
+	bool contains(int x, int y) const { return x >= left && x < right && y >= top && y < bottom; }
+};
+
+// wall-clock time spent in each phase of the last Maze::generate()
+struct GenerationStats {
+	double carveMs = 0;
+	double diameterMs = 0; // searches for the endpoints
+	int diameterSearches = 0; // full searches it took
+	int diameterGap = -1; // most steps the longest shortest path can exceed the solution by, -1 if unknown
+	double solutionMs = 0; // walking back along the path between them
 };
 
 class Maze {
 public:
-	static constexpr int pixelSize = 2;
-	static constexpr int cellSize = 16;
+	static constexpr int defaultLayers = 2;
+	// A bridge is a single deck over a ground corridor that runs across it, and that corridor always links the
+	// ground on both sides, so no later bridge can start beside the deck to pass over it. A third layer would never be used.
+	static constexpr int maxLayers = 2;
+	// where every deck is, when the maze has one
+	static constexpr int deckLayer = 1;
+
+	// layers is 1 for a maze without bridges, or 2 for the ground plus a layer of bridge decks
+	Maze(int cellWidth, int cellHeight, int layers = defaultLayers) :
+		cellWidth(cellWidth),
+		cellHeight(cellHeight),
+		layerSize(checkedLayerSize(cellWidth, cellHeight, layers)),
+		layers(layers),
+		frontier(layerSize * layers + 1)
+	{
+		// structure-of-arrays grid: one topology byte per cell, one open bit per cell
+		ownedLinks.assign(size(), 0);
+		ownedOpenBits.assign((size() + 63) / 64, 0);
+		links = ownedLinks.data();
+		openBits = ownedOpenBits.data();
+	}
+	Maze(const Maze&) = delete;
+	Maze& operator=(const Maze&) = delete;
+
+	// why the constructor would refuse these dimensions, or NULL if it takes them
+	static const char* sizeProblem(int64_t cellWidth, int64_t cellHeight, int64_t layers) {
+		if (cellWidth < 1 || cellHeight < 1)
+			return "a maze needs at least one cell";
+		if (layers < 1 || layers > maxLayers)
+			return "a maze has one or two layers";
+		// one step at a time, so the product can't wrap around before it's compared
+		if (cellHeight >= noCell / cellWidth || cellWidth * cellHeight >= noCell / layers)
+			return "maze too large";
+		return NULL;
+	}
+
+	// Maps a file written by save(). Cells are read straight out of the mapping rather than copied;
+	// the one pass over them is the check that every link is sound.
+	static std::unique_ptr<Maze> load(const std::string& path) {
+		auto file = std::make_unique<MappedFile>(path);
+		if (file->size() < sizeof(MazeFileHeader))
+			throw "bad maze file";
+		MazeFileHeader header;
+		memcpy(&header, file->data(), sizeof(header));
+		if (memcmp(header.magic, MazeFileHeader::expectedMagic, sizeof(header.magic)) != 0)
+			throw "bad maze file";
+		if (header.version != MazeFileHeader::currentVersion)
+			throw "unsupported maze file version";
+		if (header.width < 1 || header.height < 1 || header.layers < 1 || header.layers > maxLayers)
+			throw "bad maze file";
+
+		// one factor at a time, so a huge header can't wrap around to a small count
+		size_t cellCount = header.width;
+		for (size_t factor : { header.height, header.layers }) {
+			if (factor >= noCell / cellCount)
+				throw "bad maze file";
+			cellCount *= factor;
+		}
+		if (file->size() < MazeFileHeader::solutionOffset(cellCount) + header.solutionLength * sizeof(CellIndex))
+			throw "bad maze file";
+
+		return std::unique_ptr<Maze>(new Maze(header, std::move(file)));
+	}
+
+	void save(const std::string& path) {
+		MazeFileHeader header = {};
+		memcpy(header.magic, MazeFileHeader::expectedMagic, sizeof(header.magic));
+		header.version = MazeFileHeader::currentVersion;
+		header.width = static_cast<uint32_t>(cellWidth);
+		header.height = static_cast<uint32_t>(cellHeight);
+		header.layers = static_cast<uint32_t>(layers);
+		header.solutionLength = static_cast<uint32_t>(solution.size());
+		header.seed = generatedSeed;
+
+		std::ofstream out(path, std::ios::binary);
+		if (!out)
+			throw "couldn't write maze file";
+		constexpr char padding[8] = {};
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(links), size());
+		out.write(padding, MazeFileHeader::openBitsOffset(size()) - sizeof(header) - size());
+		out.write(reinterpret_cast<const char*>(openBits), (size() + 63) / 64 * sizeof(uint64_t));
+		out.write(reinterpret_cast<const char*>(solution.data()), solution.size() * sizeof(CellIndex));
+		if (!out)
+			throw "couldn't write maze file";
+	}
+
+	void setObserver(MazeObserver* newObserver) { observer = newObserver; }
+	// slack only matters for boundedDiameter: the solution may be up to that many steps shorter than the diameter
+	void setEndpointPlacement(EndpointPlacement placement, int slack = 0) {
+		endpointPlacement = placement;
+		diameterSlack = std::max(0, slack);
+	}
+
+	// the same seed, chances and engine always produce the same maze (except parallelKruskal on more than one thread)
+	// wilson and the kruskals fill the whole ground layer without bridges, and ignore branchChance and bridgeChance.
+	// For them loopChance is the chance of opening each wall that would close a loop.
+	// threadCount is only used by parallelKruskal.
+	void generate(const double branchChance, const double loopChance, const double bridgeChance, const uint64_t seed, GeneratorEngine engine = GeneratorEngine::growingTree, int threadCount = 1) {
+		Random random(seed);
+		const CarveChances chances(branchChance, loopChance, bridgeChance);
+		generatedSeed = seed;
+		Stopwatch stopwatch;
+
+		if (engine != GeneratorEngine::growingTree) {
+			if (engine == GeneratorEngine::wilson)
+				carveWilson(random, chances);
+			else if (engine == GeneratorEngine::kruskal)
+				carveKruskal(random, chances);
+			else
+				carveParallelKruskal(chances, seed, threadCount);
+			stats.carveMs = stopwatch.lap();
+			placeEndpoints(getCell(random.below(width()), random.below(height()), 0), stopwatch);
+			return;
+		}
+
+		int margin = width() > 10 && height() > 10 ? 5 : 0; // not too close to edges (increases chance that graph will not end too early)
+		int startX = margin + random.below(width() - 2 * margin);
+		int startY = margin + random.below(height() - 2 * margin);
+		CellIndex start = getCell(startX, startY, 0);
+
+		// a loop would make the maze stop being a tree, which the tracker relies on.
+		// At 12 B per cell, the tracker only lives until the endpoints are out of it.
+		const bool trackDiameter = endpointPlacement == EndpointPlacement::trackedDiameter && chances.loop == 0;
+		DiameterTracker diameterTracker;
+		if (trackDiameter)
+			diameterTracker.reset(size(), start);
+
+		frontier.clear();
+		carve(start, random, chances, { 0, 0, static_cast<int>(width()), static_cast<int>(height()) }, frontier, observer, trackDiameter ? &diameterTracker : NULL);
+		stats.carveMs = stopwatch.lap();
+
+		if (trackDiameter)
+			placeTrackedEndpoints(diameterTracker, stopwatch);
+		else
+			placeEndpoints(start, stopwatch);
+	}
+
+	// Same carving as generate(), but the plane is cut into tileSize x tileSize tiles carved concurrently by
+	// threadCount threads, each tile from its own random stream. A carve that dies out early is restarted from the open
+	// cells beside unopened ones until the tile is full. Tiles are then joined through single openings chosen like
+	// Kruskal's algorithm over the tiles, so tile trees stay a tree when loopChance is 0.
+	// The maze depends only on the seed and tileSize, never on threadCount. Observers see no individual steps,
+	// just one mazeChanged() once the tiles are joined.
+	void generateTiled(const double branchChance, const double loopChance, const double bridgeChance, const uint64_t seed, int threadCount, int tileSize = 256) {
+		const CarveChances chances(branchChance, loopChance, bridgeChance);
+		generatedSeed = seed;
+		Stopwatch stopwatch;
+
+		const int tilesAcross = (static_cast<int>(width()) + tileSize - 1) / tileSize;
+		const int tilesDown = (static_cast<int>(height()) + tileSize - 1) / tileSize;
+		const int tileCount = tilesAcross * tilesDown;
+		auto tileOf = [&](CellIndex c) -> int { return x(c) / tileSize + y(c) / tileSize * tilesAcross; };
+
+		// by coordinates, since x() and y() divide
+		auto bordersUnopened = [&](int x, int y, const TileBounds& bounds) {
+			return (x + 1 < bounds.right && !isOpen(getCell(x + 1, y, 0))) || (y > bounds.top && !isOpen(getCell(x, y - 1, 0)))
+				|| (x > bounds.left && !isOpen(getCell(x - 1, y, 0))) || (y + 1 < bounds.bottom && !isOpen(getCell(x, y + 1, 0)));
+		};
+
+		std::atomic<int> nextTile = 0;
+		auto worker = [&]() {
+			RingQueue<CellIndex> threads(static_cast<size_t>(tileSize) * tileSize + 1);
+			for (int tile = nextTile++; tile < tileCount; tile = nextTile++) {
+				int left = tile % tilesAcross * tileSize, top = tile / tilesAcross * tileSize;
+				TileBounds bounds = { left, top, std::min(left + tileSize, static_cast<int>(width())), std::min(top + tileSize, static_cast<int>(height())) };
+				Random random(seed ^ (0x9e3779b97f4a7c15ull * (tile + 1ull)));
+				CellIndex start = getCell(left + random.below(bounds.right - left), top + random.below(bounds.bottom - top), 0);
+
+				threads.clear();
+				carve(start, random, chances, bounds, threads, NULL, NULL);
+				// each restart opens a cell or adds a loop, so this ends; another pass catches cells opened behind the scan
+				for (bool grew = true; grew;) {
+					grew = false;
+					for (int y = bounds.top; y < bounds.bottom; y++) {
+						for (int x = bounds.left; x < bounds.right; x++) {
+							CellIndex c = getCell(x, y, 0);
+							while (isOpen(c) && bordersUnopened(x, y, bounds)) {
+								threads.clear();
+								carve(c, random, chances, bounds, threads, NULL, NULL);
+								grew = true;
+							}
+						}
+					}
+				}
+			}
+		};
+		std::vector<std::thread> workers;
+		for (int t = 1; t < threadCount; t++)
+			workers.emplace_back(worker);
+		worker();
+		for (std::thread& t : workers)
+			t.join();
+
+		// tiles are full, so every pair of ground cells facing each other across a tile edge could join two tiles
+		std::vector<std::pair<CellIndex, int>> seams;
+		for (int y = 0; y < height(); y++) {
+			for (int x = tileSize; x < width(); x += tileSize)
+				seams.push_back({ getCell(x - 1, y, 0), 0 });
+		}
+		for (int y = tileSize; y < height(); y += tileSize) {
+			for (int x = 0; x < width(); x++)
+				seams.push_back({ getCell(x, y - 1, 0), 3 });
+		}
+
+		Random random(seed);
+		random.shuffle(seams);
+
+		DisjointSets<int> tileGroups(tileCount);
+		for (auto [c, direction] : seams) {
+			CellIndex n = getNeighbor(c, direction);
+			int a = tileGroups.find(tileOf(c)), b = tileGroups.find(tileOf(n));
+			if (a == b && !random.chance(chances.loop))
+				continue; // already joined - only open it as a loop
+			if (a != b)
+				tileGroups.link(a, b);
+			connect(c, direction, false);
+			connect(n, (direction + 2) % 4, false);
+		}
+
+		// one search from a corner has to reach every open cell, decks included
+		const CellIndex corner = getCell(0, 0, 0);
+		size_t reached = 0, opened = 0;
+		BFS(corner, BFSHooks{ .earlyVertex = [&](CellIndex) { reached++; } });
+		for (size_t word = 0; word < (size() + 63) / 64; word++)
+			opened += std::popcount(openBits[word]);
+		if (reached != opened)
+			throw "tiles didn't join into one maze";
+		stats.carveMs = stopwatch.lap();
+		if (observer != NULL)
+			observer->mazeChanged();
+
+		placeEndpoints(corner, stopwatch);
+	}
+
+	template <BFSVisitor Visitor>
+	void BFS(CellIndex startPoint, Visitor&& visitor) {
+		beginTraversal();
+
+		if (startPoint == noCell) {
+			// find our own arbitrary start point
+			for (CellIndex c = 0; c < size(); c++) {
+				if (isOpen(c)) {
+					startPoint = c;
+					break;
+				}
+			}
+			if (startPoint == noCell)
+				throw "no open cells to start search";
+		}
+
+		RingQueue<CellIndex>& threads = frontier;
+		threads.clear();
+		threads.push_back(startPoint);
+		markDiscovered(startPoint);
+
+		while (!threads.empty()) {
+			CellIndex c = threads.pop_front();
+			if constexpr (HasEarlyVertex<Visitor>)
+				visitor.earlyVertex(c);
+
+			for (int direction = 0; direction < 4; direction++) {
+				if (!isConnected(c, direction))
+					continue;
+				CellIndex n = follow(c, direction);
+				if (n == noCell)
+					throw "followed bad connection";
+
+				if constexpr (HasEdge<Visitor>)
+					visitor.edge(c, n);
+				if (getState(n) == TraversalState::undiscovered) {
+					markDiscovered(n);
+					threads.push_back(n);
+				}
+			}
+			markProcessed(c);
+			if constexpr (HasLateVertex<Visitor>)
+				visitor.lateVertex(c);
+		}
+	}
+
+	// Same hooks as BFS, in depth-first order. Keeps its own stack of (cell, next direction),
+	// so it handles millions of cells without recursing.
+	template <BFSVisitor Visitor>
+	void DFS(CellIndex startPoint, Visitor&& visitor) {
+		beginTraversal();
+
+		struct Frame {
+			CellIndex cell;
+			uint8_t nextDirection;
+		};
+		std::vector<Frame> stack;
+		stack.push_back({ startPoint, 0 });
+		markDiscovered(startPoint);
+		if constexpr (HasEarlyVertex<Visitor>)
+			visitor.earlyVertex(startPoint);
+
+		while (!stack.empty()) {
+			Frame& top = stack.back();
+			const CellIndex c = top.cell;
+			if (top.nextDirection == 4) {
+				stack.pop_back();
+				markProcessed(c);
+				if constexpr (HasLateVertex<Visitor>)
+					visitor.lateVertex(c);
+				continue;
+			}
+			const int direction = top.nextDirection++;
+			if (!isConnected(c, direction))
+				continue;
+			CellIndex n = follow(c, direction);
+			if (n == noCell)
+				throw "followed bad connection";
+
+			if constexpr (HasEdge<Visitor>)
+				visitor.edge(c, n);
+			if (getState(n) == TraversalState::undiscovered) {
+				markDiscovered(n);
+				stack.push_back({ n, 0 }); // top is invalid from here
+				if constexpr (HasEarlyVertex<Visitor>)
+					visitor.earlyVertex(n);
+			}
+		}
+	}
+
+	// length of the shortest path between two cells, or -1 if they aren't connected
+	// only cells nearer to `from` than `to` get touched, so nearby queries stay cheap on any size of maze
+	int distance(CellIndex from, CellIndex to) {
+		beginTraversal();
+		frontier.clear();
+		frontier.push_back(from);
+		markDiscovered(from);
+
+		for (int level = 0; !frontier.empty(); level++) {
+			for (size_t remaining = frontier.size(); remaining > 0; remaining--) {
+				CellIndex c = frontier.pop_front();
+				if (c == to)
+					return level;
+				for (int direction = 0; direction < 4; direction++) {
+					if (!isConnected(c, direction))
+						continue;
+					CellIndex n = follow(c, direction);
+					if (getState(n) == TraversalState::undiscovered) {
+						markDiscovered(n);
+						frontier.push_back(n);
+					}
+				}
+				markProcessed(c);
+			}
+		}
+		return -1;
+	}
+
+	// a shortest path from `from` to `to` inclusive, or empty if they aren't connected
+	// searches outward from both ends at once, always growing the smaller frontier by a whole level,
+	// so it touches roughly two small discs around the endpoints instead of one disc reaching all the way across
+	std::vector<CellIndex> shortestPath(CellIndex from, CellIndex to) {
+		if (from == to)
+			return { from };
+		if (parentDirections.empty())
+			parentDirections.assign(size(), 0);
+		reverseFrontier.reserve(size() + 1);
+
+		// a cell's stamp says which side reached it: epoch from the `from` side, epoch + 1 from the `to` side
+		beginTraversal();
+		const uint16_t sideStamps[2] = { epoch, static_cast<uint16_t>(epoch + 1) };
+		RingQueue<CellIndex>* queues[2] = { &frontier, &reverseFrontier };
+		for (int side = 0; side < 2; side++) {
+			CellIndex root = side == 0 ? from : to;
+			queues[side]->clear();
+			queues[side]->push_back(root);
+			stamps[root] = sideStamps[side];
+		}
+
+		while (!frontier.empty() && !reverseFrontier.empty()) {
+			int side = frontier.size() <= reverseFrontier.size() ? 0 : 1;
+			RingQueue<CellIndex>& queue = *queues[side];
+			for (size_t remaining = queue.size(); remaining > 0; remaining--) {
+				CellIndex c = queue.pop_front();
+				for (int direction = 0; direction < 4; direction++) {
+					if (!isConnected(c, direction))
+						continue;
+					CellIndex n = follow(c, direction);
+					if (stamps[n] == sideStamps[side])
+						continue;
+					if (stamps[n] == sideStamps[1 - side]) {
+						// the searches met. Levels are expanded whole, so the first meeting is already a shortest path
+						CellIndex fromSide = side == 0 ? c : n;
+						CellIndex toSide = side == 0 ? n : c;
+						std::vector<CellIndex> path = walkParents(fromSide, from);
+						std::reverse(path.begin(), path.end());
+						std::vector<CellIndex> rest = walkParents(toSide, to);
+						path.insert(path.end(), rest.begin(), rest.end());
+						return path;
+					}
+					stamps[n] = sideStamps[side];
+					parentDirections[n] = static_cast<uint8_t>((direction + 2) % 4);
+					queue.push_back(n);
+				}
+			}
+		}
+		return {};
+	}
+
+	// a shortest path from `from` to `to` inclusive, or empty if they aren't connected
+	// A* guided by Manhattan distance over (x, y). Every step, including onto and off a bridge deck, moves exactly
+	// one cell across the plane, so the heuristic is consistent and the first time a cell is settled is the best.
+	// With loops there are many routes and the heuristic skips most of the maze; in a perfect maze it degrades towards BFS.
+	std::vector<CellIndex> aStarPath(CellIndex from, CellIndex to) {
+		if (parentDirections.empty())
+			parentDirections.assign(size(), 0);
+		const int targetX = x(to), targetY = y(to);
+		auto estimate = [&](CellIndex c) -> uint32_t { return std::abs(x(c) - targetX) + std::abs(y(c) - targetY); };
+
+		// cells are stamped processed once settled; the open set may hold stale duplicates, which are skipped
+		beginTraversal();
+		openSet.clear();
+		openSet.push(estimate(from), { from, 0, 0 });
+		while (!openSet.empty()) {
+			uint32_t f;
+			AStarNode node = openSet.pop(f);
+			if (getState(node.cell) == TraversalState::processed)
+				continue;
+			markProcessed(node.cell);
+			parentDirections[node.cell] = node.parentDirection;
+
+			if (node.cell == to) {
+				std::vector<CellIndex> path = walkParents(to, from);
+				std::reverse(path.begin(), path.end());
+				return path;
+			}
+
+			for (int direction = 0; direction < 4; direction++) {
+				if (!isConnected(node.cell, direction))
+					continue;
+				CellIndex n = follow(node.cell, direction);
+				if (getState(n) == TraversalState::processed)
+					continue;
+				uint32_t g = node.distance + 1;
+				openSet.push(g + estimate(n), { n, g, static_cast<uint8_t>((direction + 2) % 4) });
+			}
+		}
+		return {};
+	}
+
+	// Streams a cycle basis of the part of the maze connected to start: onCycle(cycle) gets one closed walk
+	// (first cell repeated at the end) per edge that closes a loop, so a set of walls breaking every reported cycle
+	// breaks every possible one. Returns how many were found.
+	// A BFS tree gives each extra edge (p, c) its cycle: p and c walk up the tree to their lowest common ancestor,
+	// the deeper one first. That walk is as long as the cycle, so the total work is the maze plus the output,
+	// and the cycle buffer is reused, so the callback must copy it if it wants to keep it.
+	template <typename CycleCallback>
+	size_t forEachCycle(CellIndex start, CycleCallback&& onCycle) {
+		if (treeParents.empty())
+			treeParents.assign(size(), noCell);
+		if (depths.empty())
+			depths.assign(size(), 0);
+		std::vector<CellIndex> cycle;
+		std::vector<CellIndex> otherHalf;
+		size_t found = 0;
+
+		beginTraversal();
+		frontier.clear();
+		frontier.push_back(start);
+		markDiscovered(start);
+		treeParents[start] = noCell;
+		depths[start] = 0;
+		while (!frontier.empty()) {
+			CellIndex p = frontier.pop_front();
+			for (int direction = 0; direction < 4; direction++) {
+				if (!isConnected(p, direction))
+					continue;
+				CellIndex c = follow(p, direction);
+				TraversalState state = getState(c);
+				if (state == TraversalState::undiscovered) {
+					markDiscovered(c);
+					treeParents[c] = p;
+					depths[c] = depths[p] + 1;
+					frontier.push_back(c);
+					continue;
+				}
+				// every non-tree edge is seen from both ends; report it from the end processed second.
+				// No two cells share more than one link, so the link to the parent is the tree edge.
+				if (state != TraversalState::processed || c == treeParents[p])
+					continue;
+
+				cycle.clear();
+				otherHalf.clear();
+				CellIndex a = p, b = c;
+				while (depths[a] > depths[b]) {
+					cycle.push_back(a);
+					a = treeParents[a];
+				}
+				while (depths[b] > depths[a]) {
+					otherHalf.push_back(b);
+					b = treeParents[b];
+				}
+				while (a != b) {
+					cycle.push_back(a);
+					otherHalf.push_back(b);
+					a = treeParents[a];
+					b = treeParents[b];
+				}
+				cycle.push_back(a);
+				cycle.insert(cycle.end(), otherHalf.rbegin(), otherHalf.rend());
+				cycle.push_back(p);
+				onCycle(cycle);
+				found++;
+			}
+			markProcessed(p);
+		}
+		return found;
+	}
+
+	// cells and links whose loss would split the part of the maze connected to start (articulation points and, in graph terms, bridges)
+	struct ChokePoints {
+		std::vector<CellIndex> cells; // in increasing order
+		std::vector<std::pair<CellIndex, CellIndex>> links; // (parent, child) in the search tree
+	};
+	// Tarjan's algorithm in one DFS: a cell's low link is the earliest-discovered cell its subtree reaches by one
+	// non-tree link. A child whose low link can't get above its parent makes the parent a choke cell,
+	// one whose low link stays below the child itself makes their link a choke link.
+	ChokePoints findChokePoints(CellIndex start) {
+		if (treeParents.empty())
+			treeParents.assign(size(), noCell);
+		if (discoveryOrder.empty()) {
+			discoveryOrder.assign(size(), 0);
+			lowLinks.assign(size(), 0);
+		}
+		ChokePoints points;
+		uint32_t discovered = 0;
+		int rootChildren = 0;
+
+		treeParents[start] = noCell;
+		DFS(start, BFSHooks{
+			.earlyVertex = [&](CellIndex c) { discoveryOrder[c] = lowLinks[c] = discovered++; },
+			.lateVertex = [&](CellIndex c) {
+				// every link of c is done, so its subtree's low link is final
+				CellIndex p = treeParents[c];
+				if (p == noCell)
+					return;
+				lowLinks[p] = std::min(lowLinks[p], lowLinks[c]);
+				if (lowLinks[c] > discoveryOrder[p])
+					points.links.push_back({ p, c });
+				if (p == start)
+					rootChildren++;
+				else if (lowLinks[c] >= discoveryOrder[p])
+					points.cells.push_back(p);
+			},
+			.edge = [&](CellIndex c, CellIndex n) {
+				if (getState(n) == TraversalState::undiscovered)
+					treeParents[n] = c;
+				else if (n != treeParents[c]) // no two cells share more than one link, so only the link to the parent is the tree edge
+					lowLinks[c] = std::min(lowLinks[c], discoveryOrder[n]);
+			},
+		});
+		// the root has no cells above it to reach, so it's a choke cell exactly when it has more than one subtree
+		if (rootChildren > 1)
+			points.cells.push_back(start);
+
+		// a cell is found again for each subtree that hangs off it
+		std::sort(points.cells.begin(), points.cells.end());
+		points.cells.erase(std::unique(points.cells.begin(), points.cells.end()), points.cells.end());
+		return points;
+	}
+
+	CellIndex getCell(int x, int y, int layer) {
+		if (x < 0 || y < 0 || layer < 0 || x >= cellWidth || y >= cellHeight || layer >= layers)
+			return noCell;
+		return static_cast<CellIndex>(x + cellWidth * y + layerSize * layer);
+	}
+	// adjacent cell on the same layer, whether or not there is a connection to it
+	CellIndex getNeighbor(CellIndex c, int direction) {
+		switch (direction) {
+		case 0: // right
+			return x(c) + 1 < cellWidth ? c + 1 : noCell;
+		case 1: // up
+			return y(c) > 0 ? c - static_cast<CellIndex>(cellWidth) : noCell;
+		case 2: // left
+			return x(c) > 0 ? c - 1 : noCell;
+		case 3: //  down
+			return y(c) + 1 < cellHeight ? c + static_cast<CellIndex>(cellWidth) : noCell;
+		default:
+			throw "unhandled direction";
+		}
+	}
+	// the cell reached by taking the connection out of c in the given direction
+	CellIndex follow(CellIndex c, int direction) {
+		CellIndex n = getNeighbor(c, direction);
+		if (n == noCell || !isVertical(c, direction))
+			return n;
+		// ramps always join the deck layer to the ground
+		if (z(c) == deckLayer)
+			return n - static_cast<CellIndex>(layerSize);
+		return n + static_cast<CellIndex>(layerSize);
+	}
+	// highest layer with an open cell at (x, y), or -1 if none is open
+	int topLayer(int x, int y) {
+		if (layers > deckLayer && isOpen(getCell(x, y, deckLayer)))
+			return deckLayer;
+		return isOpen(getCell(x, y, 0)) ? 0 : -1;
+	}
+	// whether something open lies over c, hiding it from above
+	bool isCovered(CellIndex c) { return topLayer(x(c), y(c)) > z(c); }
+
+	int x(CellIndex c) { return static_cast<int>(c % cellWidth); }
+	int y(CellIndex c) { return static_cast<int>(c % layerSize / cellWidth); }
+	int z(CellIndex c) { return static_cast<int>(c / layerSize); }
+
+	// low nibble: connection per direction, high nibble: that connection changes layer
+	uint8_t connections(CellIndex c) { return links[c] & 0xf; }
+	bool isConnected(CellIndex c, int direction) { return links[c] & (1 << direction); }
+	bool isVertical(CellIndex c, int direction) { return links[c] & (0x10 << direction); }
+	void connect(CellIndex c, int direction, bool vertical) {
+		links[c] |= (1 << direction) | (vertical ? 0x10 << direction : 0);
+	}
+
+	// atomic because neighbouring tiles of generateTiled() share bitmap words; relaxed is enough, and a plain load on x86
+	bool isOpen(CellIndex c) { return std::atomic_ref<uint64_t>(openBits[c / 64]).load(std::memory_order_relaxed) & (1ull << (c % 64)); }
+	void setOpen(CellIndex c) { std::atomic_ref<uint64_t>(openBits[c / 64]).fetch_or(1ull << (c % 64), std::memory_order_relaxed); }
+
+	// traversal state is only meaningful for the most recent search
+	TraversalState getState(CellIndex c) {
+		uint16_t stamp = stamps[c];
+		if (stamp == epoch)
+			return TraversalState::discovered;
+		if (stamp == epoch + 1)
+			return TraversalState::processed;
+		return TraversalState::undiscovered;
+	}
+
+	size_t width() { return cellWidth; }
+	size_t height() { return cellHeight; }
+	size_t depth() { return layers; }
+	size_t size() { return layerSize * layers; }
+
+	uint64_t seed() { return generatedSeed; }
+	const GenerationStats& generationStats() { return stats; }
+	CellIndex getStart() { return solution.empty() ? noCell : solution[0]; }
+	CellIndex getFinish() { return solution.empty() ? noCell : solution[solution.size()-1]; }
+	// start to finish, the longest shortest path found when the maze was made
+	const std::vector<CellIndex>& getSolution() { return solution; }
+
+private:
+	// Cells per layer, once the dimensions are known to be usable. Runs in the member initializers,
+	// so a bad size throws here instead of failing to allocate the search queues first.
+	static size_t checkedLayerSize(int64_t cellWidth, int64_t cellHeight, int64_t layers) {
+		if (const char* problem = sizeProblem(cellWidth, cellHeight, layers))
+			throw problem;
+		return static_cast<size_t>(cellWidth * cellHeight);
+	}
+
+	Maze(const MazeFileHeader& header, std::unique_ptr<MappedFile> file) :
+		cellWidth(header.width),
+		cellHeight(header.height),
+		layerSize(checkedLayerSize(header.width, header.height, header.layers)),
+		layers(header.layers),
+		mappedFile(std::move(file)),
+		frontier(layerSize * layers + 1)
+	{
+		uint8_t* base = mappedFile->data();
+		links = base + sizeof(MazeFileHeader);
+		openBits = reinterpret_cast<uint64_t*>(base + MazeFileHeader::openBitsOffset(size()));
+		const CellIndex* storedSolution = reinterpret_cast<const CellIndex*>(base + MazeFileHeader::solutionOffset(size()));
+		solution.assign(storedSolution, storedSolution + header.solutionLength);
+		for (CellIndex c : solution) {
+			if (c >= size())
+				throw "bad maze file";
+		}
+		// searches trust follow(), so every link must lead to an open cell that links straight back the same way
+		for (CellIndex c = 0; c < size(); c++) {
+			for (int direction = 0; direction < 4; direction++) {
+				if (!isConnected(c, direction))
+					continue;
+				CellIndex n = getNeighbor(c, direction);
+				if (n == noCell || (isVertical(c, direction) && layers <= deckLayer))
+					throw "bad maze file";
+				n = follow(c, direction);
+				const int back = (direction + 2) % 4;
+				if (!isOpen(c) || !isOpen(n) || !isConnected(n, back) || isVertical(n, back) != isVertical(c, direction))
+					throw "bad maze file";
+			}
+		}
+		generatedSeed = header.seed;
+	}
+
+	// grows a maze from start, confined to bounds
+	// every cell opened is reported to tracker as a leaf; only valid without loops
+	void carve(CellIndex start, Random& random, const CarveChances& chances, const TileBounds& bounds, RingQueue<CellIndex>& threads, MazeObserver* notify, DiameterTracker* tracker) {
+		// threads needs room for every ground cell in bounds plus one: each is queued once when it opens, the start twice
+		setOpen(start);
+		threads.push_back(start); // start in two directions from this point
+		threads.push_back(start);
+
+		while (!threads.empty()) {
+			CellIndex c = threads.pop_front();
+			do {
+				int offset = random.below(4);
+				int i = 0;
+				for (; i < 4; i++) {
+					int direction = (i + offset) % 4;
+					if (isConnected(c, direction))
+						continue; // already connected that way
+					// try to make a connection in that direction
+					CellIndex neighbor = getNeighbor(c, direction);
+					if (neighbor == noCell || !bounds.contains(x(neighbor), y(neighbor)))
+						continue;
+					bool looping = isOpen(neighbor);
+					bool canBridgeOver = false;
+					if (looping) {
+						// the new deck crosses the ground corridor of that column, unless a deck already does
+						CellIndex otherSideOfNeighbor = getNeighbor(neighbor, direction);
+						CellIndex deck = getCell(x(neighbor), y(neighbor), deckLayer);
+						canBridgeOver = deck != noCell && !isOpen(deck)
+							&& otherSideOfNeighbor != noCell && bounds.contains(x(otherSideOfNeighbor), y(otherSideOfNeighbor))
+							&& !isOpen(otherSideOfNeighbor)
+							&& !isConnected(neighbor, direction)
+							&& isConnected(neighbor, (direction + 1) % 4)
+							&& isConnected(neighbor, (direction + 3) % 4);
+						if (canBridgeOver && random.chance(chances.bridge)) {
+							// do a bridge
+							neighbor = deck;
+
+							connect(c, direction, true);
+							connect(neighbor, (direction + 2) % 4, true);
+							setOpen(neighbor);
+
+							connect(neighbor, direction, true);
+							connect(otherSideOfNeighbor, (direction + 2) % 4, true);
+							setOpen(otherSideOfNeighbor);
+
+							if (tracker != NULL) {
+								tracker->addLeaf(neighbor, c);
+								tracker->addLeaf(otherSideOfNeighbor, neighbor);
+							}
+
+							if (notify != NULL) {
+								notify->cellChanged(c);
+								notify->cellChanged(neighbor);
+								notify->cellChanged(otherSideOfNeighbor);
+								notify->stepFinished();
+							}
+
+							threads.push_back(otherSideOfNeighbor);
+							break;
+						}
+					}
+					// a ramp from the neighbour may already pass over c on this side, leaving no room for a loop
+					if (looping && (isConnected(neighbor, (direction + 2) % 4) || !random.chance(chances.loop)))
+						continue;
+
+					connect(c, direction, false);
+					connect(neighbor, (direction + 2) % 4, false);
+					setOpen(neighbor);
+					if (tracker != NULL && !looping)
+						tracker->addLeaf(neighbor, c);
+
+					if (notify != NULL) {
+						notify->cellChanged(c);
+						notify->cellChanged(neighbor);
+						notify->stepFinished();
+					}
+
+					// don't continue if we're looping into existing structure - nowhere to go
+					if (!looping)
+						threads.push_back(neighbor); 
+					break;
+				}
+				if (i == 4)
+					break; // dead end - don't consider branching further
+			} while (random.chance(chances.branch));
+		}
+	}
+
+	// Wilson's algorithm: walk randomly from each cell not yet in the maze until the walk hits the maze, remembering only the
+	// last way out of every cell (which erases loops), then add the walk. Every spanning tree is equally likely.
+	void carveWilson(Random& random, const CarveChances& chances) {
+		std::vector<uint8_t> exits(layerSize);
+		auto step = [&](CellIndex c) -> int {
+			while (true) {
+				int direction = random.below(4);
+				if (getNeighbor(c, direction) != noCell)
+					return direction;
+			}
+		};
+
+		CellIndex root = random.below(static_cast<uint32_t>(layerSize));
+		setOpen(root);
+		for (CellIndex walkStart = 0; walkStart < layerSize; walkStart++) {
+			if (isOpen(walkStart))
+				continue;
+			for (CellIndex c = walkStart; !isOpen(c); c = getNeighbor(c, exits[c]))
+				exits[c] = static_cast<uint8_t>(step(c));
+			for (CellIndex c = walkStart; !isOpen(c);) {
+				CellIndex next = getNeighbor(c, exits[c]);
+				connect(c, exits[c], false);
+				connect(next, (exits[c] + 2) % 4, false);
+				setOpen(c);
+				if (observer != NULL) {
+					observer->cellChanged(c);
+					observer->cellChanged(next);
+				}
+				c = next;
+			}
+			if (observer != NULL)
+				observer->stepFinished();
+		}
+		braid(random, chances);
+	}
+
+	// Kruskal's algorithm: knock down walls in random order whenever they separate two unconnected regions
+	void carveKruskal(Random& random, const CarveChances& chances) {
+		std::vector<uint64_t> walls = listWalls(0, static_cast<CellIndex>(layerSize));
+		random.shuffle(walls);
+
+		DisjointSets<CellIndex> regions(layerSize);
+		for (uint64_t wall : walls) {
+			CellIndex c = wallCell(wall);
+			int direction = wallDirection(wall);
+			CellIndex n = getNeighbor(c, direction);
+			CellIndex a = regions.find(c), b = regions.find(n);
+			if (a == b && !random.chance(chances.loop))
+				continue;
+			regions.link(a, b);
+			connect(c, direction, false);
+			connect(n, (direction + 2) % 4, false);
+			setOpen(c);
+			setOpen(n);
+			if (observer != NULL) {
+				observer->cellChanged(c);
+				observer->cellChanged(n);
+				observer->stepFinished();
+			}
+		}
+	}
+
+	// ground walls are numbered 2 * cell for the wall to the cell's right, 2 * cell + 1 for the wall below it,
+	// in 64 bits since a layer can hold more than 2^31 cells
+	static CellIndex wallCell(uint64_t wall) { return static_cast<CellIndex>(wall / 2); }
+	static int wallDirection(uint64_t wall) { return wall % 2 == 0 ? 0 : 3; }
+	// the walls of ground cells first..last - 1 that have a cell on their other side
+	std::vector<uint64_t> listWalls(CellIndex first, CellIndex last) {
+		std::vector<uint64_t> walls;
+		walls.reserve(size_t(last - first) * 2);
+		for (CellIndex c = first; c < last; c++) {
+			if (x(c) + 1 < cellWidth)
+				walls.push_back(uint64_t(c) * 2);
+			if (y(c) + 1 < cellHeight)
+				walls.push_back(uint64_t(c) * 2 + 1);
+		}
+		return walls;
+	}
+
+	// Kruskal on threadCount threads at once. Each thread lists and shuffles the walls of its own slice of the grid, then
+	// knocks them down in that order against a shared lock-free union-find. Every thread advances through its slice at
+	// about the same rate, so each wall still gets an effectively random place in the overall order.
+	// Which thread wins a race decides which of two walls survives, so the result is only repeatable on one thread.
+	void carveParallelKruskal(const CarveChances& chances, uint64_t seed, int threadCount) {
+		std::vector<CellIndex> regions(layerSize);
+		auto findRegion = [&](CellIndex c) -> CellIndex {
+			while (true) {
+				CellIndex parent = std::atomic_ref<CellIndex>(regions[c]).load(std::memory_order_acquire);
+				if (parent == c)
+					return c;
+				CellIndex grandparent = std::atomic_ref<CellIndex>(regions[parent]).load(std::memory_order_acquire);
+				// path halving; losing this race just means someone else already shortened the path
+				std::atomic_ref<CellIndex>(regions[c]).compare_exchange_weak(parent, grandparent, std::memory_order_release, std::memory_order_relaxed);
+				c = grandparent;
+			}
+		};
+		// true if a and b were in different regions and are now joined
+		auto unite = [&](CellIndex a, CellIndex b) -> bool {
+			while (true) {
+				a = findRegion(a);
+				b = findRegion(b);
+				if (a == b)
+					return false;
+				// always hang the lower root under the higher one, so concurrent links can never form a cycle
+				if (a > b)
+					std::swap(a, b);
+				CellIndex expected = a;
+				if (std::atomic_ref<CellIndex>(regions[a]).compare_exchange_strong(expected, b, std::memory_order_acq_rel))
+					return true;
+				// a stopped being a root under us - look again
+			}
+		};
+		auto connectShared = [&](CellIndex c, int direction) {
+			std::atomic_ref<uint8_t>(links[c]).fetch_or(static_cast<uint8_t>(1 << direction), std::memory_order_relaxed);
+			setOpen(c);
+		};
+
+		threadCount = std::max(1, threadCount);
+		std::vector<std::vector<uint64_t>> slices(threadCount);
+		auto prepare = [&](int slice) {
+			CellIndex first = static_cast<CellIndex>(layerSize * slice / threadCount);
+			CellIndex last = static_cast<CellIndex>(layerSize * (slice + 1) / threadCount);
+			for (CellIndex c = first; c < last; c++)
+				regions[c] = c;
+			Random random(seed ^ (0x9e3779b97f4a7c15ull * (slice + 1ull)));
+			slices[slice] = listWalls(first, last);
+			random.shuffle(slices[slice]);
+		};
+		auto knockDown = [&](int slice) {
+			Random random(seed ^ (0xbf58476d1ce4e5b9ull * (slice + 1ull)));
+			for (uint64_t wall : slices[slice]) {
+				CellIndex c = wallCell(wall);
+				int direction = wallDirection(wall);
+				CellIndex n = getNeighbor(c, direction);
+				if (!unite(c, n) && !random.chance(chances.loop))
+					continue;
+				connectShared(c, direction);
+				connectShared(n, (direction + 2) % 4);
+			}
+		};
+
+		auto onEveryThread = [&](auto& task) {
+			std::vector<std::thread> workers;
+			for (int t = 1; t < threadCount; t++)
+				workers.emplace_back([&task, t]() { task(t); });
+			task(0);
+			for (std::thread& t : workers)
+				t.join();
+		};
+		// every slice's regions must be initialised before anyone starts uniting across slices
+		onEveryThread(prepare);
+		onEveryThread(knockDown);
+		if (observer != NULL)
+			observer->mazeChanged();
+	}
+
+	// opens each remaining ground wall with the loop chance
+	void braid(Random& random, const CarveChances& chances) {
+		if (chances.loop == 0)
+			return;
+		for (CellIndex c = 0; c < layerSize; c++) {
+			for (int direction : { 0, 3 }) {
+				CellIndex n = getNeighbor(c, direction);
+				if (n == noCell || isConnected(c, direction) || !random.chance(chances.loop))
+					continue;
+				connect(c, direction, false);
+				connect(n, (direction + 2) % 4, false);
+				if (observer != NULL) {
+					observer->cellChanged(c);
+					observer->cellChanged(n);
+					observer->stepFinished();
+				}
+			}
+		}
+	}
+
+	void placeEndpoints(CellIndex start, Stopwatch& stopwatch) {
+		solution.clear();
+		stats.diameterGap = -1;
+
+		if (endpointPlacement == EndpointPlacement::boundedDiameter) {
+			auto [from, to] = boundDiameter(start);
+			stats.diameterMs = stopwatch.lap();
+			solution = shortestPath(from, to);
+			stats.solutionMs = stopwatch.lap();
+
+			if (solution.empty())
+				throw "no solution?";
+			if (observer != NULL)
+				observer->solutionChanged();
+			return;
+		}
+
+		// pick out a start and end point - try to place them at network diameter
+		// that is, the longest shortest path between nodes
+		CellIndex farthestCell = start;
+		auto lateVertex = [&](CellIndex c) -> void { farthestCell = c; };
+		BFS(start, BFSHooks{ .lateVertex = lateVertex });
+
+		std::vector<CellIndex> prevLinks(size(), noCell);
+		auto prevLinkEdge = [&](CellIndex p, CellIndex c) -> void {
+			if (getState(c) == TraversalState::undiscovered)
+				prevLinks[c] = p;
+		};
+		BFS(farthestCell, BFSHooks{ .lateVertex = lateVertex, .edge = prevLinkEdge });
+		stats.diameterMs = stopwatch.lap();
+		stats.diameterSearches = 2;
+
+		while (farthestCell != noCell) {
+			solution.push_back(farthestCell);
+			farthestCell = prevLinks[farthestCell];
+		};
+
+		stats.solutionMs = stopwatch.lap();
+
+		if (solution.empty())
+			throw "no solution?";
+		if (observer != NULL)
+			observer->solutionChanged();
+	}
+
+	// the endpoints were found while carving, so only the path between them is left to walk
+	void placeTrackedEndpoints(DiameterTracker& diameterTracker, Stopwatch& stopwatch) {
+		stats.diameterMs = stopwatch.lap();
+		stats.diameterSearches = 0;
+		stats.diameterGap = 0;
+		solution = diameterTracker.path();
+		stats.solutionMs = stopwatch.lap();
+
+		if (observer != NULL)
+			observer->solutionChanged();
+	}
+
+	// how many steps the farthest reachable cell is from `from`; the reached cells are left in order, nearest first,
+	// with their distances in distances. linkEnds counts each connection between them twice.
+	uint32_t sweepDistances(CellIndex from, std::vector<CellIndex>& order, std::vector<uint32_t>& distances, size_t* linkEnds = NULL) {
+		beginTraversal();
+		order.clear();
+		frontier.clear();
+		frontier.push_back(from);
+		markDiscovered(from);
+		distances[from] = 0;
+
+		while (!frontier.empty()) {
+			CellIndex c = frontier.pop_front();
+			order.push_back(c);
+			for (int direction = 0; direction < 4; direction++) {
+				if (!isConnected(c, direction))
+					continue;
+				if (linkEnds != NULL)
+					(*linkEnds)++;
+				CellIndex n = follow(c, direction);
+				if (getState(n) == TraversalState::undiscovered) {
+					markDiscovered(n);
+					distances[n] = distances[c] + 1;
+					frontier.push_back(n);
+				}
+			}
+			markProcessed(c);
+		}
+		stats.diameterSearches++;
+		return distances[order.back()];
+	}
+
+	// Ends of a path within diameterSlack steps of the longest shortest path, found by bounding every cell's eccentricity
+	// (its distance to the farthest cell) in the spirit of iFUB. A search from w reaching v in d steps bounds v's
+	// eccentricity to [max(d, ecc(w) - d), ecc(w) + d]. A cell whose upper bound is within the slack of the longest path
+	// found so far is dropped, and the diameter is settled once none are left.
+	// The first searches are the double sweep's, then the cell midway between its ends; after that searches alternate
+	// between the candidate with the highest upper bound (likely an end) and the one with the lowest lower bound (likely
+	// central, tightening everyone's upper bounds). Braided mazes rarely have a centre within a few steps of half the
+	// diameter, so unlike iFUB's showcase graphs they still take tens of searches. The bounds are 16 B per cell and
+	// only live for the call.
+	std::pair<CellIndex, CellIndex> boundDiameter(CellIndex start) {
+		stats.diameterSearches = 0;
+		std::vector<CellIndex> order;
+		std::vector<uint32_t> distances(size());
+		std::vector<uint32_t> lows(size(), 0);
+		std::vector<uint32_t> highs(size(), UINT32_MAX);
+
+		std::pair<CellIndex, CellIndex> ends = { start, start };
+		uint32_t lower = 0;
+		uint32_t ceiling = 0; // highest upper bound of any dropped cell
+		bool wantEnd = false;
+		for (CellIndex w = start; ;) {
+			size_t linkEnds = 0;
+			const bool first = stats.diameterSearches == 0;
+			uint32_t eccentricity = sweepDistances(w, order, distances, first ? &linkEnds : NULL);
+			if (eccentricity > lower) {
+				lower = eccentricity;
+				ends = { w, order.back() };
+			}
+			// a tree's farthest cell from anywhere is one end of a longest path, so the double sweep is exact there,
+			// while the bounds would have to pin down every leaf around an off-centre middle one by one
+			if (first && linkEnds == 2 * (order.size() - 1)) {
+				CellIndex from = order.back();
+				sweepDistances(from, order, distances);
+				stats.diameterGap = 0;
+				return { from, order.back() };
+			}
+
+			// dropped cells keep an upper bound of 0
+			CellIndex likelyEnd = noCell, likelyCentre = noCell;
+			for (CellIndex c : order) {
+				uint32_t d = distances[c];
+				lows[c] = std::max({ lows[c], d, eccentricity - d });
+				highs[c] = std::min(highs[c], eccentricity + d);
+				if (highs[c] <= lower + static_cast<uint32_t>(diameterSlack)) {
+					ceiling = std::max(ceiling, highs[c]);
+					highs[c] = 0;
+					continue;
+				}
+				if (likelyEnd == noCell || highs[c] > highs[likelyEnd])
+					likelyEnd = c;
+				if (likelyCentre == noCell || lows[c] < lows[likelyCentre])
+					likelyCentre = c;
+			}
+			if (likelyEnd == noCell)
+				break;
+			if (stats.diameterSearches < 3) {
+				// the double sweep: the far end from start, then the far end from that
+				w = order.back();
+				if (highs[w] == 0)
+					w = likelyEnd;
+			} else if (stats.diameterSearches == 3) {
+				// then the middle of the path it found, walking back from the far end one step nearer at a time
+				for (w = order.back(); distances[w] > eccentricity / 2;) {
+					int direction = 0;
+					while (!isConnected(w, direction) || distances[follow(w, direction)] + 1 != distances[w])
+						direction++;
+					w = follow(w, direction);
+				}
+				if (highs[w] == 0)
+					w = likelyCentre;
+				wantEnd = true;
+			} else {
+				w = wantEnd ? likelyEnd : likelyCentre;
+				wantEnd = !wantEnd;
+			}
+		}
+		stats.diameterGap = std::max(ceiling, lower) - lower;
+		return ends;
+	}
+
+	MazeObserver* observer = NULL;
+	EndpointPlacement endpointPlacement = EndpointPlacement::diameterSearch;
+	int diameterSlack = 0;
+
+	// maze data
+	// links and openBits point either at the owned vectors or into a mapped file
+	size_t cellWidth, cellHeight;
+	size_t layerSize;
+	size_t layers; // each layer is a contiguous block of layerSize cells, ground first
+	uint8_t* links;
+	uint64_t* openBits;
+	std::vector<uint8_t> ownedLinks;
+	std::vector<uint64_t> ownedOpenBits;
+	std::unique_ptr<MappedFile> mappedFile;
+
+	// search scratch space, reused by every traversal
+	// each search gets a fresh pair of stamp values, so anything stamped by an earlier search reads as undiscovered
+	std::vector<uint16_t> stamps;
+	uint16_t epoch = 0; // discovered == epoch, processed == epoch + 1
+	RingQueue<CellIndex> frontier;
+	RingQueue<CellIndex> reverseFrontier; // second frontier for searches from both ends, allocated on first use
+	std::vector<uint8_t> parentDirections; // direction back towards the search root, valid for cells stamped by the latest search
+	// the latest search tree (forEachCycle's BFS or findChokePoints' DFS): parent cell,
+	// and distance from the root for forEachCycle
+	std::vector<CellIndex> treeParents;
+	std::vector<uint32_t> depths;
+	// findChokePoints' DFS numbering, and the earliest-numbered cell each subtree links back to
+	std::vector<uint32_t> discoveryOrder;
+	std::vector<uint32_t> lowLinks;
+
+	struct AStarNode {
+		CellIndex cell;
+		uint32_t distance; // from the start
+		uint8_t parentDirection;
+	};
+	RadixHeap<AStarNode> openSet;
+
+	void beginTraversal() {
+		if (stamps.empty())
+			stamps.assign(size(), 0); // allocated on first use so that loading a maze stays instant
+		if (epoch >= UINT16_MAX - 2) {
+			// out of fresh stamps - the one full sweep every ~32k searches
+			std::fill(stamps.begin(), stamps.end(), 0);
+			epoch = 0;
+		}
+		epoch += 2;
+	}
+	void markDiscovered(CellIndex c) { stamps[c] = epoch; }
+	void markProcessed(CellIndex c) { stamps[c] = epoch + 1; }
+
+	// cells from c back to root by following parentDirections
+	std::vector<CellIndex> walkParents(CellIndex c, CellIndex root) {
+		std::vector<CellIndex> path;
+		path.push_back(c);
+		while (c != root) {
+			c = follow(c, parentDirections[c]);
+			path.push_back(c);
+		}
+		return path;
+	}
+
+	uint64_t generatedSeed = 0;
+	GenerationStats stats;
+	std::vector<CellIndex> solution;
+};
+
+// Distances and paths between any two cells of a maze without loops, in O(1) and O(path length) after one linear pass.
+// A DFS from root writes an Euler tour (every cell each time the walk passes through it), and the lowest common ancestor
+// of two cells is the shallowest cell on the tour between their first visits. That range minimum comes from a sparse
+// table over blocks of 32 tour entries, plus one mask per entry of which earlier entries in its block are still minima
+// of the range ending there, so the in-block part is a single lowest-set-bit lookup.
+class TreeDistanceOracle {
+public:
+	// the cells connected to root must form a tree, as they do when loopChance is 0
+	TreeDistanceOracle(Maze& maze, CellIndex root) {
+		parents.assign(maze.size(), noCell);
+		depths.assign(maze.size(), 0);
+		firstVisits.assign(maze.size(), notReached);
+		tour.reserve(2 * maze.size());
+
+		maze.DFS(root, BFSHooks{
+			.earlyVertex = [&](CellIndex c) {
+				firstVisits[c] = static_cast<uint32_t>(tour.size());
+				tour.push_back(c);
+			},
+			// back in the parent once c's subtree is done
+			.lateVertex = [&](CellIndex c) {
+				if (parents[c] != noCell)
+					tour.push_back(parents[c]);
+			},
+			.edge = [&](CellIndex c, CellIndex n) {
+				if (n == parents[c])
+					return;
+				if (firstVisits[n] != notReached)
+					throw "maze has loops";
+				parents[n] = c;
+				depths[n] = depths[c] + 1;
+			},
+		});
+
+		// in-block masks: bit j of masks[i] is set while tour entry j of the block is the minimum of [j, i]
+		masks.resize(tour.size());
+		for (size_t i = 0; i < tour.size(); i++) {
+			uint32_t mask = i % blockSize == 0 ? 0 : masks[i - 1];
+			while (mask != 0) {
+				size_t highest = (i & ~(blockSize - 1)) + std::bit_width(mask) - 1;
+				if (depthAt(highest) <= depthAt(i))
+					break;
+				mask &= ~(1u << (highest % blockSize));
+			}
+			masks[i] = mask | 1u << (i % blockSize);
+		}
+
+		// sparse table: blockMinima[k][b] is the shallowest entry of blocks b .. b + 2^k - 1
+		const size_t blocks = (tour.size() + blockSize - 1) / blockSize;
+		blockMinima.emplace_back(blocks);
+		for (size_t b = 0; b < blocks; b++)
+			blockMinima[0][b] = minimumInBlock(b * blockSize, std::min(tour.size(), (b + 1) * blockSize) - 1);
+		for (size_t k = 1; (size_t(1) << k) <= blocks; k++) {
+			const std::vector<uint32_t>& below = blockMinima[k - 1];
+			std::vector<uint32_t> level(blocks - (size_t(1) << k) + 1);
+			for (size_t b = 0; b < level.size(); b++)
+				level[b] = shallower(below[b], below[b + (size_t(1) << (k - 1))]);
+			blockMinima.push_back(std::move(level));
+		}
+	}
+
+	bool contains(CellIndex c) const { return firstVisits[c] != notReached; }
+
+	CellIndex lowestCommonAncestor(CellIndex a, CellIndex b) const {
+		if (!contains(a) || !contains(b))
+			throw "cell not in the tree";
+		uint32_t left = firstVisits[a], right = firstVisits[b];
+		if (left > right)
+			std::swap(left, right);
+		return tour[minimumInRange(left, right)];
+	}
+	uint32_t distance(CellIndex a, CellIndex b) const { return depths[a] + depths[b] - 2 * depths[lowestCommonAncestor(a, b)]; }
+	// the cells from a to b inclusive
+	std::vector<CellIndex> path(CellIndex a, CellIndex b) const {
+		const CellIndex meeting = lowestCommonAncestor(a, b);
+		std::vector<CellIndex> cells;
+		cells.reserve(depths[a] + depths[b] - 2 * depths[meeting] + 1);
+		for (CellIndex c = a; c != meeting; c = parents[c])
+			cells.push_back(c);
+		cells.push_back(meeting);
+		const size_t middle = cells.size();
+		for (CellIndex c = b; c != meeting; c = parents[c])
+			cells.push_back(c);
+		std::reverse(cells.begin() + middle, cells.end());
+		return cells;
+	}
+
+private:
+	static constexpr uint32_t notReached = UINT32_MAX;
+	static constexpr size_t blockSize = 32; // bits in a mask
+
+	uint32_t depthAt(size_t entry) const { return depths[tour[entry]]; }
+	uint32_t shallower(uint32_t a, uint32_t b) const { return depthAt(b) < depthAt(a) ? b : a; }
+	// first and last in the same block
+	uint32_t minimumInBlock(size_t first, size_t last) const {
+		uint32_t mask = masks[last] & ~0u << (first % blockSize);
+		return static_cast<uint32_t>((last & ~(blockSize - 1)) + std::countr_zero(mask));
+	}
+	uint32_t minimumInRange(size_t first, size_t last) const {
+		const size_t firstBlock = first / blockSize, lastBlock = last / blockSize;
+		if (firstBlock == lastBlock)
+			return minimumInBlock(first, last);
+		uint32_t best = shallower(minimumInBlock(first, firstBlock * blockSize + blockSize - 1), minimumInBlock(lastBlock * blockSize, last));
+		if (lastBlock - firstBlock > 1) {
+			// two overlapping power-of-two runs cover the whole blocks between
+			const size_t from = firstBlock + 1, count = lastBlock - from;
+			const int k = std::bit_width(count) - 1;
+			best = shallower(best, shallower(blockMinima[k][from], blockMinima[k][lastBlock - (size_t(1) << k)]));
+		}
+		return best;
+	}
+
+	std::vector<CellIndex> parents;
+	std::vector<uint32_t> depths;
+	std::vector<uint32_t> firstVisits; // index into tour
+	std::vector<CellIndex> tour;
+	std::vector<uint32_t> masks;
+	std::vector<std::vector<uint32_t>> blockMinima;
+};
+
+// The 16x16 tile bitmaps, built on the CPU so they can be drawn with or without a renderer.
+// Pixels are RGBA8888 (0xRRGGBBAA), the same layout SDL_PIXELFORMAT_RGBA8888 uses; alpha is either 0 or 0xff.
+class TileSet {
+public:
+	static constexpr int cellSize = 16;
+	// the 16 connection tiles are indexed by connection bits, the start and end markers follow,
+	// then the choke point overlays: one bar per direction for choke links, and a dot for choke cells
+	static constexpr int startTile = 1 << 4;
+	static constexpr int endTile = startTile + 1;
+	static constexpr int chokeLinkTile = endTile + 1;
+	static constexpr int chokeCellTile = chokeLinkTile + 4;
+	static constexpr int count = chokeCellTile + 1;
+
+	TileSet() {
+		constexpr Uint32 black = 0x000000ff, white = 0xffffffff, orange = 0xff8800ff;
+		for (auto& tile : tiles)
+			tile.fill(0x00000000); // transparent
+
+		// choke overlays: bars from the middle to the right, top, left and bottom edges, and a dot
+		constexpr int half = cellSize / 2;
+		fillRect(chokeLinkTile + 0, half, half - 1, half, 2, orange);
+		fillRect(chokeLinkTile + 1, half - 1, 0, 2, half, orange);
+		fillRect(chokeLinkTile + 2, 0, half - 1, half, 2, orange);
+		fillRect(chokeLinkTile + 3, half - 1, half, 2, half, orange);
+		fillRect(chokeCellTile, half - 3, half - 3, 6, 6, orange);
+
+		// end: a diamond
+		for (int i = 1; i <= cellSize / 2 - 3; i++) {
+			for (int j = -i; j < i; j++) {
+				int x = cellSize / 2 + j;
+				tiles[endTile][x + cellSize * (i + 2)] = black;
+				tiles[endTile][x + cellSize * (cellSize - 3 - i)] = black;
+			}
+		}
+		// start: a square
+		fillRect(startTile, 3, 3, cellSize - 6, cellSize - 6, black);
+
+		// empty tile at index 0
+		for (int y = 0; y < cellSize; y++)
+			for (int x = 0; x < cellSize; x++)
+				tiles[0][y * cellSize + x] = (x + y) % 2 ? white : black;
+
+		// maze tiles
+		for (int i = 1; i < 1 << 4; i++) {
+			bool right = i & 1;
+			bool up = i & 2;
+			bool left = i & 4;
+			bool down = i & 8;
+
+			Uint32 color = black;
+			for (int margin = 1; margin <= 2; margin++) {
+				// horizontal connections
+				int longthMargin = 2 * margin;
+				if (right)
+					longthMargin -= margin;
+				if (left)
+					longthMargin -= margin;
+				fillRect(i, left ? 0 : margin, margin, cellSize - longthMargin, cellSize - 2 * margin, color);
+
+				// vertical connections
+				longthMargin = 2 * margin;
+				if (up)
+					longthMargin -= margin;
+				if (down)
+					longthMargin -= margin;
+				fillRect(i, margin, up ? 0 : margin, cellSize - 2 * margin, cellSize - longthMargin, color);
+
+				color = white; // switch to white for second time around
+			}
+		}
+	}
+
+	const Uint32* row(int tile, int y) const { return tiles[tile].data() + y * cellSize; }
+
+private:
+	void fillRect(int tile, int left, int top, int w, int h, Uint32 color) {
+		for (int y = top; y < top + h; y++)
+			std::fill_n(tiles[tile].data() + y * cellSize + left, w, color);
+	}
+
+	std::array<std::array<Uint32, cellSize * cellSize>, count> tiles;
+};
+
+// Renders a whole maze into a CPU framebuffer by copying tile rows, the way MazeRenderer draws it:
+// every cell starts as the empty tile, open cells go on top lower layers first, then the start and end markers.
+// Needs no window or GPU, so it works for snapshots and for mazes far larger than any texture.
+class SoftwareRasterizer {
+public:
+	static constexpr int cellSize = TileSet::cellSize;
+
+	SoftwareRasterizer(Maze& maze) : maze(maze) {}
+
+	int width() { return static_cast<int>(maze.width()) * cellSize; }
+	int height() { return static_cast<int>(maze.height()) * cellSize; }
+
+	// one band of cellSize pixel rows for the cells in row cellY. pitch is in pixels.
+	// Lets large images be produced band by band without holding the whole framebuffer.
+	void renderRow(int cellY, Uint32* dest, size_t pitch) { renderRow(cellY, dest, pitch, 0, static_cast<int>(maze.width())); }
+	// only cells left to right - 1, with dest at the first pixel of cell left
+	void renderRow(int cellY, Uint32* dest, size_t pitch, int left, int right) {
+		for (int x = left; x < right; x++) {
+			Uint32* cellPixels = dest + (x - left) * cellSize;
+			// the empty tile is opaque, so it's a straight copy; 64 bytes a row, which the compiler turns into vector moves
+			for (int y = 0; y < cellSize; y++)
+				memcpy(cellPixels + y * pitch, tiles.row(0, y), cellSize * sizeof(Uint32));
+
+			for (int z = 0; z < maze.depth(); z++) {
+				CellIndex c = maze.getCell(x, cellY, z);
+				if (!maze.isOpen(c))
+					continue;
+				overlay(maze.connections(c), cellPixels, pitch);
+				if (c == maze.getStart())
+					overlay(TileSet::startTile, cellPixels, pitch);
+				else if (c == maze.getFinish())
+					overlay(TileSet::endTile, cellPixels, pitch);
+			}
+			if (!pathLinks.empty())
+				drawPath(x, cellY, cellPixels, pitch);
+		}
+	}
+	// draws path on top of the maze like MazeRenderer::renderPath(): a blended bar for every connection the path takes
+	void setPath(const std::vector<CellIndex>& path, Uint32 color) {
+		pathColor = color;
+		pathLinks.clear();
+		for (size_t i = 1; i < path.size(); i++) {
+			for (int direction = 0; direction < 4; direction++) {
+				if (maze.isConnected(path[i - 1], direction) && maze.follow(path[i - 1], direction) == path[i]) {
+					pathLinks.push_back({ path[i - 1], static_cast<uint8_t>(1 << direction) });
+					pathLinks.push_back({ path[i], static_cast<uint8_t>(1 << (direction + 2) % 4) });
+					break;
+				}
+			}
+		}
+		// one entry per cell holding all its path directions, sorted for lookup by cell
+		std::sort(pathLinks.begin(), pathLinks.end());
+		size_t merged = 0;
+		for (size_t i = 0; i < pathLinks.size(); i++) {
+			if (merged > 0 && pathLinks[merged - 1].first == pathLinks[i].first)
+				pathLinks[merged - 1].second |= pathLinks[i].second;
+			else
+				pathLinks[merged++] = pathLinks[i];
+		}
+		pathLinks.resize(merged);
+	}
+	// the whole maze, pitch is width()
+	std::vector<Uint32> render() {
+		std::vector<Uint32> pixels(static_cast<size_t>(width()) * height());
+		for (int y = 0; y < maze.height(); y++)
+			renderRow(y, pixels.data() + static_cast<size_t>(y) * cellSize * width(), width());
+		return pixels;
+	}
+
+private:
+	// copies the tile's opaque pixels. Branch-free so each row becomes a handful of vector selects.
+	void overlay(int tile, Uint32* dest, size_t pitch) {
+		for (int y = 0; y < cellSize; y++) {
+			const Uint32* src = tiles.row(tile, y);
+			Uint32* out = dest + y * pitch;
+			for (int x = 0; x < cellSize; x++) {
+				Uint32 keep = (src[x] & 0xff) ? 0 : 0xffffffff;
+				out[x] = (out[x] & keep) | (src[x] & ~keep);
+			}
+		}
+	}
+
+	void drawPath(int x, int y, Uint32* dest, size_t pitch) {
+		for (int z = 0; z < maze.depth(); z++) {
+			CellIndex c = maze.getCell(x, y, z);
+			// don't draw if covered by another cell
+			if (maze.isCovered(c))
+				continue;
+			auto found = std::lower_bound(pathLinks.begin(), pathLinks.end(), std::make_pair(c, uint8_t(0)));
+			if (found == pathLinks.end() || found->first != c)
+				continue;
+			for (int direction = 0; direction < 4; direction++) {
+				if (!(found->second & (1 << direction)))
+					continue;
+				bool isHorizontal = direction % 2 == 0;
+				blendRect(dest, pitch, direction == 2 ? 0 : 3, direction == 1 ? 0 : 3, cellSize - (isHorizontal ? 3 : 6), cellSize - (!isHorizontal ? 3 : 6));
+			}
+		}
+	}
+	// SDL_BLENDMODE_BLEND of pathColor over an opaque destination
+	void blendRect(Uint32* dest, size_t pitch, int left, int top, int w, int h) {
+		const Uint32 alpha = pathColor & 0xff;
+		for (int y = top; y < top + h; y++) {
+			for (int x = left; x < left + w; x++) {
+				Uint32& out = dest[y * pitch + x];
+				Uint32 blended = 0xff;
+				for (int shift = 8; shift < 32; shift += 8) {
+					Uint32 src = (pathColor >> shift) & 0xff, dst = (out >> shift) & 0xff;
+					blended |= (src * alpha + dst * (255 - alpha)) / 255 << shift;
+				}
+				out = blended;
+			}
+		}
+	}
+
+	Maze& maze;
+	TileSet tiles;
+	std::vector<std::pair<CellIndex, uint8_t>> pathLinks; // cell, directions the path takes out of it
+	Uint32 pathColor = 0;
+};
+
+// Writes an image one band of scanlines at a time, so only a band ever needs to be in memory.
+// Pixels come in as RGBA8888 and are stored as 8-bit RGB.
+class ImageWriter {
+public:
+	virtual ~ImageWriter() = default;
+	// picks the format from the file extension: .png or .ppm
+	static std::unique_ptr<ImageWriter> open(const std::string& path, int width, int height);
+
+	// rows must arrive top to bottom, height rows in total. pitch is in pixels.
+	virtual void writeRows(const Uint32* pixels, size_t pitch, int rows) = 0;
+	virtual void finish() {}
+
+protected:
+	ImageWriter(const std::string& path, int width, int height) : out(path, std::ios::binary), width(width), height(height) {
+		if (!out)
+			throw "couldn't open image file for writing";
+		scanline.resize(static_cast<size_t>(width) * 3);
+	}
+	const uint8_t* toRGB(const Uint32* row) {
+		for (int x = 0; x < width; x++) {
+			scanline[x * 3] = static_cast<uint8_t>(row[x] >> 24);
+			scanline[x * 3 + 1] = static_cast<uint8_t>(row[x] >> 16);
+			scanline[x * 3 + 2] = static_cast<uint8_t>(row[x] >> 8);
+		}
+		return scanline.data();
+	}
+
+	std::ofstream out;
+	const int width;
+	const int height;
+	std::vector<uint8_t> scanline;
+};
+
+// binary netpbm: a short text header, then raw RGB
+class PPMWriter : public ImageWriter {
+public:
+	PPMWriter(const std::string& path, int width, int height) : ImageWriter(path, width, height) {
+		out << "P6\n" << width << " " << height << "\n255\n";
+	}
+	void writeRows(const Uint32* pixels, size_t pitch, int rows) override {
+		for (int y = 0; y < rows; y++)
+			out.write(reinterpret_cast<const char*>(toRGB(pixels + y * pitch)), scanline.size());
+		if (!out)
+			throw "failed writing image";
+	}
+};
+
+// PNG without a compression library: the zlib stream is made of stored (uncompressed) deflate blocks,
+// which only need lengths and an Adler-32 checksum. Each band becomes one IDAT chunk.
+class PNGWriter : public ImageWriter {
+public:
+	PNGWriter(const std::string& path, int width, int height) : ImageWriter(path, width, height) {
+		const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		out.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+		std::vector<uint8_t> header;
+		appendBigEndian(header, width);
+		appendBigEndian(header, height);
+		header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bits per channel, RGB, deflate, standard filters, not interlaced
+		writeChunk("IHDR", header);
+
+		chunk = { 0x78, 0x01 }; // zlib header: deflate with a 32k window, no preset dictionary
+	}
+	void writeRows(const Uint32* pixels, size_t pitch, int rows) override {
+		for (int y = 0; y < rows; y++) {
+			pending.push_back(0); // filter type: none
+			const uint8_t* rgb = toRGB(pixels + y * pitch);
+			pending.insert(pending.end(), rgb, rgb + scanline.size());
+		}
+		adler.update(pending.data(), pending.size());
+
+		// stored blocks hold at most 65535 bytes
+		for (size_t offset = 0; offset < pending.size(); offset += 0xffff) {
+			uint16_t length = static_cast<uint16_t>(std::min<size_t>(0xffff, pending.size() - offset));
+			appendStoredBlockHeader(chunk, length, false);
+			chunk.insert(chunk.end(), pending.begin() + offset, pending.begin() + offset + length);
+		}
+		pending.clear();
+		writeChunk("IDAT", chunk);
+		chunk.clear();
+	}
+	void finish() override {
+		// an empty final block ends the deflate stream
+		appendStoredBlockHeader(chunk, 0, true);
+		appendBigEndian(chunk, adler.value());
+		writeChunk("IDAT", chunk);
+		writeChunk("IEND", {});
+		if (!out)
+			throw "failed writing image";
+	}
+
+private:
+	struct Adler32 {
+		uint32_t a = 1, b = 0;
+		void update(const uint8_t* data, size_t length) {
+			while (length > 0) {
+				// 5552 is the most bytes that can be summed before b could overflow 32 bits
+				size_t run = std::min<size_t>(length, 5552);
+				for (size_t i = 0; i < run; i++) {
+					a += data[i];
+					b += a;
+				}
+				a %= 65521;
+				b %= 65521;
+				data += run;
+				length -= run;
+			}
+		}
+		uint32_t value() const { return b << 16 | a; }
+	};
+
+	static uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc) {
+		static const std::array<uint32_t, 256> table = []() {
+			std::array<uint32_t, 256> table;
+			for (uint32_t n = 0; n < 256; n++) {
+				uint32_t c = n;
+				for (int k = 0; k < 8; k++)
+					c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+				table[n] = c;
+			}
+			return table;
+		}();
+		for (size_t i = 0; i < length; i++)
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		return crc;
+	}
+	static void appendBigEndian(std::vector<uint8_t>& bytes, uint32_t value) {
+		for (int shift = 24; shift >= 0; shift -= 8)
+			bytes.push_back(static_cast<uint8_t>(value >> shift));
+	}
+	static void appendStoredBlockHeader(std::vector<uint8_t>& bytes, uint16_t length, bool final) {
+		// BFINAL and BTYPE 00 in the first byte; stored blocks are byte aligned so the rest is padding
+		bytes.insert(bytes.end(), { static_cast<uint8_t>(final), static_cast<uint8_t>(length), static_cast<uint8_t>(length >> 8),
+			static_cast<uint8_t>(~length), static_cast<uint8_t>(~length >> 8) });
+	}
+	void writeChunk(const char type[4], const std::vector<uint8_t>& data) {
+		std::vector<uint8_t> length;
+		appendBigEndian(length, static_cast<uint32_t>(data.size()));
+		out.write(reinterpret_cast<const char*>(length.data()), 4);
+		out.write(type, 4);
+		out.write(reinterpret_cast<const char*>(data.data()), data.size());
+		uint32_t crc = crc32(reinterpret_cast<const uint8_t*>(type), 4, 0xffffffff);
+		crc = crc32(data.data(), data.size(), crc) ^ 0xffffffff;
+		std::vector<uint8_t> crcBytes;
+		appendBigEndian(crcBytes, crc);
+		out.write(reinterpret_cast<const char*>(crcBytes.data()), 4);
+	}
+
+	std::vector<uint8_t> pending;
+	std::vector<uint8_t> chunk;
+	Adler32 adler;
+};
 
-	Maze(int screenWidth, int screenHeight) :
-		cellWidth(screenWidth / pixelSize / cellSize),
-		cellHeight(screenHeight / pixelSize / cellSize)
-	{
-		// round down to full cell size
-		screenWidth /= pixelSize;
-		screenHeight /= pixelSize;
-		screenWidth -= screenWidth % cellSize;
-		screenHeight -= screenHeight % cellSize;
+std::unique_ptr<ImageWriter> ImageWriter::open(const std::string& path, int width, int height) {
+	if (path.ends_with(".png"))
+		return std::make_unique<PNGWriter>(path, width, height);
+	if (path.ends_with(".ppm"))
+		return std::make_unique<PPMWriter>(path, width, height);
+	throw "unsupported image format, use .png or .ppm";
+}
 
-		context = std::make_unique<SDLContext>(screenWidth, screenHeight, pixelSize);
-		initTextures();
+// Renders maze straight into an image file, one row of cells at a time; memory use is one band of pixels.
+void exportImage(Maze& maze, const std::string& path, bool withSolution) {
+	constexpr Uint32 solutionColor = 0xbb0000c0;
+	SoftwareRasterizer rasterizer(maze);
+	if (withSolution)
+		rasterizer.setPath(maze.getSolution(), solutionColor);
+	std::unique_ptr<ImageWriter> writer = ImageWriter::open(path, rasterizer.width(), rasterizer.height());
+	std::vector<Uint32> band(static_cast<size_t>(rasterizer.width()) * SoftwareRasterizer::cellSize);
+	for (int y = 0; y < maze.height(); y++) {
+		rasterizer.renderRow(y, band.data(), rasterizer.width());
+		writer->writeRows(band.data(), rasterizer.width(), SoftwareRasterizer::cellSize);
+	}
+	writer->finish();
+}
 
-		// initialize maze grid
-		cells.resize(cellWidth * cellHeight * layers);
-		for (int z = 0; z < layers; z++) {
-			for (int y = 0; y < cellHeight; y++) {
-				for (int x = 0; x < cellWidth; x++) {
-					Cell* c = getCell(x, y, z);
-					c->x = x;
-					c->y = y;
-					c->z = z;
+// Grey levels for drawing a maze zoomed far out, where a cell is smaller than a screen pixel.
+// Level 0 is one value per cell, the average brightness of its tiles; it isn't stored but looked up from the
+// cell's connections. Each level above halves both sides, averaging 2x2 blocks of the level below, so any
+// zoom can be drawn by reading one level at one value per screen pixel - the cost depends on the window, not the maze.
+class LODPyramid {
+public:
+	LODPyramid(Maze& maze) : maze(maze) {
+		// brightness of every ground/deck tile combination, with noTile for a cell that isn't open
+		TileSet tiles;
+		for (int ground = 0; ground <= noTile; ground++) {
+			for (int deck = 0; deck <= noTile; deck++) {
+				int white = 0;
+				for (int y = 0; y < TileSet::cellSize; y++) {
+					for (int x = 0; x < TileSet::cellSize; x++) {
+						Uint32 pixel = tiles.row(0, y)[x];
+						for (int tile : { ground, deck })
+							if (tile != noTile && (tiles.row(tile, y)[x] & 0xff))
+								pixel = tiles.row(tile, y)[x];
+						white += pixel >> 24; // tiles are black and white, so any channel will do
+					}
 				}
+				brightness[ground][deck] = static_cast<uint8_t>(white / (TileSet::cellSize * TileSet::cellSize));
 			}
 		}
+		build();
+	}
 
-		// initial (blank) render
-		//SDL_SetRenderDrawColor(context->renderer(), 0x88, 0x88, 0x88, 0xff);
-		//SDL_RenderFillRect(context->renderer(), NULL);
-		for (int i = 0; i < cells.size(); i++) {
-			int x = i % cellWidth;
-			int y = i / cellWidth;
-			SDL_Rect destRect = { x * cellSize, y * cellSize, cellSize, cellSize };
-			SDL_RenderCopy(context->renderer(), tileTextures[0], NULL, &destRect);
+	// recomputes every level, for when the whole maze has changed
+	void build() {
+		levels.clear();
+		int w = static_cast<int>(maze.width()), h = static_cast<int>(maze.height());
+		for (int level = 1; w > 1 || h > 1; level++) {
+			w = (w + 1) / 2;
+			h = (h + 1) / 2;
+			levels.push_back({ w, h, std::vector<uint8_t>(static_cast<size_t>(w) * h) });
+			for (int y = 0; y < h; y++)
+				for (int x = 0; x < w; x++)
+					recompute(level, x, y);
+		}
+	}
+	// brings the levels above c up to date after it changed, O(levels)
+	void update(CellIndex c) {
+		int x = maze.x(c), y = maze.y(c);
+		for (int level = 1; level <= levelCount(); level++) {
+			x /= 2;
+			y /= 2;
+			recompute(level, x, y);
 		}
-		SDL_RenderPresent(context->renderer());
 	}
 
-	void generate(const double branchChance, const double loopChance, const double bridgeChance) {
-		int startX = 5 + rand() % (width() - 10); // not too close to edges (increases chance that graph will not end too early)
-		int startY = 5 + rand() % (height() - 10);
-		Cell* start = getCell(startX, startY, 0);
-
-		std::vector<Cell*> threads;
-		start->open = true;
-		threads.push_back(start); // start in two directions from this point
-		threads.push_back(start);
+	// levels above 0; level n covers 2^n x 2^n cells per value
+	int levelCount() { return static_cast<int>(levels.size()); }
+	int levelWidth(int level) { return level == 0 ? static_cast<int>(maze.width()) : levels[level - 1].width; }
+	int levelHeight(int level) { return level == 0 ? static_cast<int>(maze.height()) : levels[level - 1].height; }
+	uint8_t value(int level, int x, int y) {
+		if (level > 0)
+			return levels[level - 1].values[static_cast<size_t>(y) * levels[level - 1].width + x];
+		// the ground and, where there is one, the deck over it
+		CellIndex ground = maze.getCell(x, y, 0);
+		const int top = maze.topLayer(x, y);
+		return brightness[maze.isOpen(ground) ? maze.connections(ground) : noTile][top > 0 ? maze.connections(maze.getCell(x, y, top)) : noTile];
+	}
 
-		while (!threads.empty()) {
-			Cell* c = threads.front();
-			threads.erase(threads.begin());
-			do {
-				int offset = rand() % 4;
-				int i = 0;
-				for (; i < 4; i++) {
-					int direction = (i + offset) % 4;
-					if (c->connections[direction])
-						continue; // already connected that way
-					// try to make a connection in that direction
-					Cell* neighbor = getNeighbor(c, direction);
-					if (neighbor == NULL)
-						continue;
-					bool looping = neighbor->open;
-					bool canBridgeOver = false;
-					if (looping) {
-						Cell* otherSideOfNeighbor = getNeighbor(neighbor, direction);
-						canBridgeOver = otherSideOfNeighbor != NULL && !otherSideOfNeighbor->open
-							&& !neighbor->connections[direction]
-							&& neighbor->connections[(direction + 1) % 4]
-							&& neighbor->connections[(direction + 3) % 4];
-						if (canBridgeOver && ((double)rand() / RAND_MAX) < bridgeChance) {
-							// do a bridge
-							neighbor = getCell(neighbor->x, neighbor->y, neighbor->z + 1); // layer above
+private:
+	struct Level {
+		int width;
+		int height;
+		std::vector<uint8_t> values;
+	};
+	static constexpr int noTile = 1 << 4;
+
+	// average of the up to four values below; blocks hanging off the right or bottom edge just have fewer
+	void recompute(int level, int x, int y) {
+		int sum = 0, count = 0;
+		for (int childY = 2 * y; childY < std::min(2 * y + 2, levelHeight(level - 1)); childY++) {
+			for (int childX = 2 * x; childX < std::min(2 * x + 2, levelWidth(level - 1)); childX++) {
+				sum += value(level - 1, childX, childY);
+				count++;
+			}
+		}
+		levels[level - 1].values[static_cast<size_t>(y) * levels[level - 1].width + x] = static_cast<uint8_t>(sum / count);
+	}
 
-							c->connections[direction] = true;
-							c->verticalConnections[direction] = VerticalDirection::up;
-							neighbor->connections[(direction + 2) % 4] = true;
-							neighbor->verticalConnections[(direction + 2) % 4] = VerticalDirection::down;
-							neighbor->open = true;
+	Maze& maze;
+	uint8_t brightness[noTile + 1][noTile + 1];
+	std::vector<Level> levels;
+};
 
-							neighbor->connections[direction] = true;
-							neighbor->verticalConnections[direction] = VerticalDirection::down;
-							otherSideOfNeighbor->connections[(direction + 2) % 4] = true;
-							otherSideOfNeighbor->verticalConnections[(direction + 2) % 4] = VerticalDirection::up;
-							otherSideOfNeighbor->open = true;
+// Draws a Maze into an SDL window. Attach with Maze::setObserver() to animate generation.
+// The window shows a view onto the maze that can be dragged and zoomed with the mouse, so a maze can be any size;
+// only cells inside the view are ever drawn.
+class MazeRenderer : public MazeObserver {
+public:
+	static constexpr int pixelSize = 2;
+	static constexpr int cellSize = TileSet::cellSize;
+	// largest window, in screen pixels; smaller mazes get a window that just fits them
+	static constexpr int maxScreenWidth = 2000;
+	static constexpr int maxScreenHeight = 1200;
+	// Zoomed out past lodZoom, cells are drawn from an LODPyramid instead of tiles, at one value per screen pixel.
+	// The view can then zoom out until the whole maze fits.
+	static constexpr double lodZoom = 0.25;
+	static constexpr double maxZoom = 8;
+
+	// how many cells fit along a screen edge of the given size
+	static int cellsForScreen(int screenPixels) { return screenPixels / pixelSize / cellSize; }
+
+	MazeRenderer(Maze& maze) : maze(maze), lod(maze) {
+		const int mazeWidth = static_cast<int>(maze.width()) * cellSize, mazeHeight = static_cast<int>(maze.height()) * cellSize;
+		context = std::make_unique<SDLContext>(std::min(mazeWidth, maxScreenWidth / pixelSize), std::min(mazeHeight, maxScreenHeight / pixelSize), pixelSize);
+		initTextures();
 
-							renderCell(c);
-							renderCell(neighbor);
-							renderCell(otherSideOfNeighbor);
-							present();
+		// the visible cells of the widest tiled view, plus a partial cell at each edge
+		const int frameCellsAcross = std::min(static_cast<int>(maze.width()), static_cast<int>(context->width / lodZoom / cellSize) + 2);
+		const int frameCellsDown = std::min(static_cast<int>(maze.height()), static_cast<int>(context->height / lodZoom / cellSize) + 2);
+		frameTexture = SDL_CreateTexture(context->renderer(), SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, frameCellsAcross * cellSize, frameCellsDown * cellSize);
+		lodTexture = SDL_CreateTexture(context->renderer(), SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, context->width, context->height);
+		if (frameTexture == NULL || lodTexture == NULL)
+			throw "unable to create texture";
 
-							threads.push_back(otherSideOfNeighbor);
-							break;
-						}
-					}
-					if (looping && ((double)rand() / RAND_MAX) >= loopChance)
-						continue;
+		dirtyFlags.assign(maze.size(), 0);
+		clampView();
+		// initial (blank) render
+		renderAll();
+	}
 
-					c->connections[direction] = true;
-					neighbor->connections[(direction + 2) % 4] = true;
-					neighbor->open = true;
+	// During generation, changed cells are only collected; they are drawn and shown together once a frame is due -
+	// when frameInterval has passed since the last present, or after stepsPerFrame carve steps if that is set.
+	// Generation then runs at full speed instead of waiting on the display for every step.
+	void setFrameInterval(std::chrono::microseconds interval) { frameInterval = interval; }
+	void setStepsPerFrame(int steps) { stepsPerFrame = steps; }
 
-					renderCell(c);
-					renderCell(neighbor);
-					present();
+	void cellChanged(CellIndex c) override {
+		if (dirtyFlags[c])
+			return;
+		dirtyFlags[c] = 1;
+		dirtyCells.push_back(c);
+	}
+	void stepFinished() override {
+		stepsSincePresent++;
+		if (stepsPerFrame > 0 ? stepsSincePresent >= stepsPerFrame : std::chrono::steady_clock::now() - lastPresent >= frameInterval)
+			present();
+	}
+	void solutionChanged() override {
+		renderCell(maze.getStart());
+		renderCell(maze.getFinish());
+		present();
+	}
+	void mazeChanged() override {
+		lod.build();
+		renderAll();
+	}
 
-					// don't continue if we're looping into existing structure - nowhere to go
-					if (!looping)
-						threads.push_back(neighbor); 
-					break;
-				}
-				if (i == 4)
-					break; // dead end - don't consider branching further
-			} while (((double)rand() / RAND_MAX) < branchChance);
+	// Redraws the whole view: the visible cells are drawn in software and uploaded as one texture instead of
+	// being submitted cell by cell, then the paths drawn so far go back on top.
+	void renderAll() {
+		for (CellIndex c : dirtyCells) {
+			lod.update(c);
+			dirtyFlags[c] = 0;
 		}
+		dirtyCells.clear();
+		drawView();
+		present();
+	}
 
-		// pick out a start and end point - try to place them at network diameter
-		// that is, the longest shortest path between nodes
-		Cell* farthestCell = start;
-		std::function<void(Cell*, Cell*)> nopEdge = [&](Cell* p, Cell* c) -> void {};
-		std::function<void(Cell*)> nopVertex = [&](Cell* c) -> void {};
-		std::function<void(Cell*)> lateVertex = [&](Cell* c) -> void { farthestCell = c; };
-		BFS(start, nopVertex, lateVertex, nopEdge);
-
-		std::vector<Cell*> prevLinks(size(), NULL);
-		auto getIndex = [&](Cell* c) -> size_t { return c - data(); };
-		std::function<void(Cell*, Cell*)> prevLinkEdge = [&](Cell* p, Cell* c) -> void {
-			if (c->state == TraversalState::undiscovered)
-				prevLinks[getIndex(c)] = p;
-		};
-		BFS(farthestCell, nopVertex, lateVertex, prevLinkEdge);
+	// queued, not drawn - tiles go out in one batch at the next present() or path drawing
+	void renderCell(CellIndex c) {
+		if (usingLOD()) {
+			// too small for tiles; present() redraws the view from the pyramid
+			cellChanged(c);
+			return;
+		}
+		if (!isVisible(c))
+			return;
+		queueTile(maze.connections(c), maze.x(c), maze.y(c));
 
-		while (farthestCell != NULL) {
-			solution.push_back(farthestCell);
-			farthestCell = prevLinks[getIndex(farthestCell)];
+		if (c == maze.getStart())
+			queueTile(startTile, maze.x(c), maze.y(c));
+		else if (c == maze.getFinish())
+			queueTile(endTile, maze.x(c), maze.y(c));
+		queueOverlay(c);
+	};
+	// Marks choke points until the next call replaces them: a dot on each choke cell, and a bar along each
+	// choke link from both of its cells. The marks are queued along with the tiles, so redrawn cells keep them.
+	void renderChokePoints(const Maze::ChokePoints& points) {
+		if (overlayFlags.empty())
+			overlayFlags.assign(maze.size(), 0);
+		for (CellIndex c : overlayCells)
+			overlayFlags[c] = 0;
+		overlayCells.clear();
+
+		auto mark = [this](CellIndex c, uint8_t flag) {
+			if (overlayFlags[c] == 0)
+				overlayCells.push_back(c);
+			overlayFlags[c] |= flag;
 		};
-
-		if (solution.empty())
-			throw "no solution?";
-		SDL_Rect destRect = { solution[0]->x * cellSize, solution[0]->y * cellSize, cellSize, cellSize };
-		SDL_RenderCopy(context->renderer(), startTex, NULL, &destRect);
-		destRect.x = solution[solution.size()-1]->x * cellSize;
-		destRect.y = solution[solution.size() - 1]->y * cellSize;
-		SDL_RenderCopy(context->renderer(), endTex, NULL, &destRect);
-		present();
+		for (CellIndex c : points.cells)
+			mark(c, chokeCellFlag);
+		for (auto [from, to] : points.links) {
+			int direction = directionBetween(from, to);
+			mark(from, 1 << direction);
+			mark(to, 1 << (direction + 2) % 4);
+		}
+		renderAll();
+	}
+	// draws path as a thick line. The latest path of each colour is kept so it can be redrawn when the view moves.
+	void renderPath(const std::vector<CellIndex>& path, const Uint32 color) {
+		auto kept = std::find_if(paths.begin(), paths.end(), [color](const auto& entry) { return entry.first == color; });
+		if (kept == paths.end())
+			paths.push_back({ color, path });
+		else
+			kept->second = path;
+		drawPath(path, color);
 	}
+	// draws path as a one pixel line, each one a little offset from the last so overlapping paths stay apart
+	void renderThinPath(const std::vector<CellIndex>& path, const Uint32 color) {
+		const int pathCount = (cellSize - 6) / 2;
+		static int counter = -1;
+		counter++;
+		int pathIndex = counter % pathCount;
 
-	void BFS(Cell* startPoint, std::function<void(Cell*)> earlyVertex, std::function<void(Cell*)> lateVertex, std::function<void(Cell*, Cell*)> edge) {
-		resetTraversalState();
+		CellRect bounds = { INT_MAX, INT_MAX, INT_MIN, INT_MIN };
+		for (CellIndex c : path) {
+			bounds.left = std::min(bounds.left, maze.x(c));
+			bounds.top = std::min(bounds.top, maze.y(c));
+			bounds.right = std::max(bounds.right, maze.x(c) + 1);
+			bounds.bottom = std::max(bounds.bottom, maze.y(c) + 1);
+		}
+		thinPaths.push_back({ path, color, 3 + pathIndex * 2, bounds });
+		drawThinPath(thinPaths.back());
+	}
+	void clearCell(CellIndex c) {
+		renderCell(c);
+		rerenderCellsAbove(c);
+	}
+	void clearPath(std::vector<CellIndex>& path) {
+		for (CellIndex c : path)
+			clearCell(c);
+	}
+	// draws any cells still waiting from generation, then shows the frame
+	void present() {
+		// lower layers first, so bridges end up on top
+		std::sort(dirtyCells.begin(), dirtyCells.end());
+		const bool cellsChanged = !dirtyCells.empty();
+		for (CellIndex c : dirtyCells) {
+			lod.update(c);
+			if (!usingLOD())
+				renderCell(c);
+			dirtyFlags[c] = 0;
+		}
+		dirtyCells.clear();
+		if (usingLOD() && cellsChanged)
+			drawView();
+		flushTiles();
 
-		if (startPoint == NULL) {
-			// find our own arbitrary start point
-			for (Cell& c : cells) {
-				if (c.open) {
-					startPoint = &c;
-					break;
-				}
-			}
-			throw "no open cells to start search";
+		SDL_RenderPresent(context->renderer());
+		lastPresent = std::chrono::steady_clock::now();
+		stepsSincePresent = 0;
+	}
+	void setTitle(const std::string& title) { context->setTitle(title); }
+
+	// Mouse control of the view: drag with the left button to pan, wheel to zoom around the pointer.
+	// Returns whether the event was used. The view is only redrawn by updateView(), so a burst of events costs one redraw.
+	bool handleEvent(const SDL_Event& e) {
+		if (e.type == SDL_MOUSEMOTION && (e.motion.state & SDL_BUTTON_LMASK)) {
+			// with a logical size set, SDL already reports motion in view pixels
+			viewLeft -= e.motion.xrel / zoom;
+			viewTop -= e.motion.yrel / zoom;
+		} else if (e.type == SDL_MOUSEWHEEL && e.wheel.y != 0) {
+			int mouseX, mouseY;
+			SDL_GetMouseState(&mouseX, &mouseY);
+			zoomAt(static_cast<double>(mouseX) / pixelSize, static_cast<double>(mouseY) / pixelSize, std::pow(1.25, e.wheel.y));
+		} else {
+			return false;
 		}
+		viewMoved = true;
+		return true;
+	}
+	void updateView() {
+		if (!viewMoved)
+			return;
+		viewMoved = false;
+		clampView();
+		renderAll();
+	}
 
-		std::vector<Cell*> threads;
-		threads.push_back(startPoint);
-		startPoint->state = TraversalState::discovered;
+private:
+	// the cells at least partly inside the view
+	struct CellRect {
+		int left = 0, top = 0, right = 0, bottom = 0;
+	};
+	struct ThinPath {
+		std::vector<CellIndex> cells;
+		Uint32 color;
+		int offset;
+		CellRect bounds; // so paths out of view are skipped without walking them
+	};
 
-		while (!threads.empty()) {
-			Cell* c = threads.front();
-			threads.erase(threads.begin());
-			earlyVertex(c);
+	bool usingLOD() { return zoom < lodZoom; }
+	// out far enough to see the whole maze, but never further than needed to switch to the pyramid
+	double minZoom() {
+		double fit = std::min(static_cast<double>(context->width) / (maze.width() * cellSize), static_cast<double>(context->height) / (maze.height() * cellSize));
+		return std::min(fit, lodZoom);
+	}
 
-			for (int direction = 0; direction < 4; direction++) {
-				if (!c->connections[direction])
-					continue;
-				Cell* n = getNeighbor(c, direction, c->verticalConnections[direction]);
-				if (n == NULL)
-					throw "followed bad connection";
+	// everything in view: the cells and their overlays, then the paths drawn so far on top
+	void drawView() {
+		tileVertices.clear();
+		tileIndices.clear();
+		if (usingLOD()) {
+			drawLOD();
+		} else {
+			drawTiles();
+			for (CellIndex c : overlayCells)
+				queueOverlay(c);
+		}
 
-				edge(c, n);
-				if (n->state == TraversalState::undiscovered) {
-					n->state = TraversalState::discovered;
-					threads.push_back(n);
-				}
+		for (const ThinPath& thin : thinPaths)
+			drawThinPath(thin);
+		for (const auto& [color, path] : paths)
+			drawPath(path, color);
+	}
+	// the visible cells at full detail, drawn in software and uploaded as one texture
+	void drawTiles() {
+		const int across = visible.right - visible.left, down = visible.bottom - visible.top;
+		const size_t pitch = static_cast<size_t>(across) * cellSize;
+		framePixels.resize(pitch * down * cellSize);
+		SoftwareRasterizer rasterizer(maze);
+		for (int y = visible.top; y < visible.bottom; y++)
+			rasterizer.renderRow(y, framePixels.data() + (y - visible.top) * cellSize * pitch, pitch, visible.left, visible.right);
+
+		SDL_Rect source = { 0, 0, across * cellSize, down * cellSize };
+		SDL_UpdateTexture(frameTexture, &source, framePixels.data(), static_cast<int>(pitch * sizeof(Uint32)));
+		SDL_FRect dest = { screenX(visible.left * cellSize), screenY(visible.top * cellSize),
+			static_cast<float>(source.w * zoom), static_cast<float>(source.h * zoom) };
+		SDL_SetRenderDrawColor(context->renderer(), 0x00, 0x00, 0x00, 0xff);
+		SDL_RenderClear(context->renderer());
+		SDL_RenderCopyF(context->renderer(), frameTexture, &source, &dest);
+	}
+	// one grey pixel per view pixel, read from the pyramid level whose values are closest to a pixel in size
+	void drawLOD() {
+		const double cellsPerPixel = 1.0 / (zoom * cellSize);
+		int level = 0;
+		while (level < lod.levelCount() && (2 << level) <= cellsPerPixel)
+			level++;
+
+		// which value each view column and row reads, or -1 off the maze
+		auto valueIndices = [&](std::vector<int>& indices, int pixels, double viewStart, int cells) {
+			indices.resize(pixels);
+			for (int i = 0; i < pixels; i++) {
+				int cell = static_cast<int>(std::floor((viewStart + (i + 0.5) / zoom) / cellSize));
+				indices[i] = cell >= 0 && cell < cells ? cell >> level : -1;
+			}
+		};
+		valueIndices(lodColumns, context->width, viewLeft, static_cast<int>(maze.width()));
+		valueIndices(lodRows, context->height, viewTop, static_cast<int>(maze.height()));
+
+		lodPixels.resize(static_cast<size_t>(context->width) * context->height);
+		Uint32* out = lodPixels.data();
+		for (int row : lodRows) {
+			for (int column : lodColumns) {
+				Uint32 grey = row < 0 || column < 0 ? 0 : lod.value(level, column, row);
+				*out++ = grey << 24 | grey << 16 | grey << 8 | 0xff;
 			}
-			c->state = TraversalState::processed;
-			lateVertex(c);
 		}
+		SDL_UpdateTexture(lodTexture, NULL, lodPixels.data(), context->width * static_cast<int>(sizeof(Uint32)));
+		SDL_RenderCopy(context->renderer(), lodTexture, NULL, NULL);
 	}
 
-	Cell* getCell(int x, int y, int layer) {
-		if (x < 0 || y < 0 || layer < 0 || x >= cellWidth || y >= cellHeight || layer >= layers)
-			return NULL;
-		return &cells[x + cellWidth * y + cellWidth*cellHeight*layer];
+	bool isVisible(CellIndex c) {
+		int x = maze.x(c), y = maze.y(c);
+		return x >= visible.left && x < visible.right && y >= visible.top && y < visible.bottom;
 	}
-	Cell* getNeighbor(Cell* c, int direction, VerticalDirection verticalDirection = VerticalDirection::flat) {
-		switch (direction) {
-		case 0: // right
-			return getCell(c->x + 1, c->y, c->z + static_cast<int>(verticalDirection));
-		case 1: // up
-			return getCell(c->x, c->y - 1, c->z + static_cast<int>(verticalDirection));
-		case 2: // left
-			return getCell(c->x - 1, c->y, c->z + static_cast<int>(verticalDirection));
-		case 3: //  down
-			return getCell(c->x, c->y + 1, c->z + static_cast<int>(verticalDirection));
-		default:
-			throw "unhandled direction";
-		}
+	// maze pixels to view pixels
+	float screenX(double x) { return static_cast<float>((x - viewLeft) * zoom); }
+	float screenY(double y) { return static_cast<float>((y - viewTop) * zoom); }
+
+	// keeps the same maze point under (x, y) in view pixels
+	void zoomAt(double x, double y, double factor) {
+		const double newZoom = std::clamp(zoom * factor, minZoom(), maxZoom);
+		viewLeft += x / zoom - x / newZoom;
+		viewTop += y / zoom - y / newZoom;
+		zoom = newZoom;
 	}
-
-	void resetTraversalState() {
-		for (Cell& c : cells) {
-			c.state = TraversalState::undiscovered;
-		}
+	// keeps the view on the maze, centring it along any side where it doesn't fill the window, and works out visible cells
+	void clampView() {
+		auto clampAxis = [](double& start, double viewSpan, double mazeSpan) {
+			if (viewSpan >= mazeSpan)
+				start = (mazeSpan - viewSpan) / 2;
+			else
+				start = std::clamp(start, 0.0, mazeSpan - viewSpan);
+		};
+		const double viewWidth = context->width / zoom, viewHeight = context->height / zoom;
+		clampAxis(viewLeft, viewWidth, static_cast<double>(maze.width()) * cellSize);
+		clampAxis(viewTop, viewHeight, static_cast<double>(maze.height()) * cellSize);
+
+		visible.left = std::max(0, static_cast<int>(std::floor(viewLeft / cellSize)));
+		visible.top = std::max(0, static_cast<int>(std::floor(viewTop / cellSize)));
+		visible.right = std::min(static_cast<int>(maze.width()), static_cast<int>(std::ceil((viewLeft + viewWidth) / cellSize)));
+		visible.bottom = std::min(static_cast<int>(maze.height()), static_cast<int>(std::ceil((viewTop + viewHeight) / cellSize)));
 	}
 
-	void renderCell(Cell* c) {
-		size_t textureIndex = c->connections.to_ulong();
-		SDL_Rect destRect = { c->x * cellSize, c->y * cellSize, cellSize, cellSize };
-		SDL_RenderCopy(context->renderer(), tileTextures[textureIndex], NULL, &destRect);
-
-		if (solution.empty())
-			return;
-		if (c == solution[0]) {
-			SDL_Rect destRect = { c->x * cellSize, c->y * cellSize, cellSize, cellSize };
-			SDL_RenderCopy(context->renderer(), startTex, NULL, &destRect);
-		}
-		else if (c == solution[solution.size() - 1]) {
-			SDL_Rect destRect = { c->x * cellSize, c->y * cellSize, cellSize, cellSize };
-			SDL_RenderCopy(context->renderer(), endTex, NULL, &destRect);
-		}
-	};
-	void renderPath(std::vector<Cell*>& path, const Uint32 color) {
+	void drawPath(const std::vector<CellIndex>& path, const Uint32 color) {
+		flushTiles();
 		SDL_SetRenderDrawColor(context->renderer(), color >> 24, (color >> 16) & 0xff, (color >> 8) & 0xff, color & 0xff);
 
-		auto drawConnection = [this](Cell* c, int direction) -> void {
+		auto drawConnection = [this](CellIndex c, int direction) -> void {
+			if (!isVisible(c))
+				return;
 			// don't draw if covered by another cell
-			Cell* above = getCell(c->x, c->y, c->z + 1);
-			if (above != NULL && above->open)
+			if (maze.isCovered(c))
 				return;
 
 			bool isHorizontal = direction % 2 == 0;
-			SDL_Rect rect = {
-				c->x * cellSize + (direction==2 ? 0 : 3),
-				c->y * cellSize + (direction==1 ? 0 : 3),
-				cellSize - (isHorizontal ? 3 : 6),
-				cellSize - (!isHorizontal ? 3 : 6)
+			SDL_FRect rect = {
+				screenX(maze.x(c) * cellSize + (direction==2 ? 0 : 3)),
+				screenY(maze.y(c) * cellSize + (direction==1 ? 0 : 3)),
+				static_cast<float>((cellSize - (isHorizontal ? 3 : 6)) * zoom),
+				static_cast<float>((cellSize - (!isHorizontal ? 3 : 6)) * zoom)
 			};
-			SDL_RenderFillRect(context->renderer(), &rect);
+			SDL_RenderFillRectF(context->renderer(), &rect);
 		};
 
 		for (int i = 1; i < path.size(); i++) {
-			int dx = path[i]->x - path[i - 1ll]->x;
-			int dy = path[i]->y - path[i - 1ll]->y;
-			
-			int direction = 0;
-			if (dx != 0)
-				direction = (dx > 0) ? 0 : 2;
-			else if (dy != 0)
-				direction = (dy > 0) ? 3 : 1;
-			else
-				throw "path doesn't make sense";
-
+			int direction = directionBetween(path[i - 1ll], path[i]);
 			drawConnection(path[i], (direction + 2) % 4);
 			drawConnection(path[i - 1ll], direction);
 		}
 	}
-	void renderThinPath(std::vector<Cell*>& path, const Uint32 color) {
+	// which way `to` lies from its neighbour `from`
+	int directionBetween(CellIndex from, CellIndex to) {
+		int dx = maze.x(to) - maze.x(from);
+		int dy = maze.y(to) - maze.y(from);
+		if (dx != 0)
+			return (dx > 0) ? 0 : 2;
+		if (dy != 0)
+			return (dy > 0) ? 3 : 1;
+		throw "path doesn't make sense";
+	}
+	void drawThinPath(const ThinPath& path) {
+		if (path.bounds.right <= visible.left || path.bounds.left >= visible.right || path.bounds.bottom <= visible.top || path.bounds.top >= visible.bottom)
+			return;
+		flushTiles();
+		const Uint32 color = path.color;
 		SDL_SetRenderDrawColor(context->renderer(), color >> 24, (color >> 16) & 0xff, (color >> 8) & 0xff, color & 0xff);
 
-		const int pathCount = (cellSize - 6) / 2;
-		static int counter = -1;
-		counter++;
-		int pathIndex = counter % pathCount;
-		int offset = 3 + pathIndex * 2;
-
-		for (int i = 1; i < path.size(); i++) {
-			SDL_RenderDrawLine(
+		const std::vector<CellIndex>& cells = path.cells;
+		for (int i = 1; i < cells.size(); i++) {
+			// neighbours, so the segment is on screen only if one of its ends is
+			if (!isVisible(cells[i - 1ll]) && !isVisible(cells[i]))
+				continue;
+			SDL_RenderDrawLineF(
 				context->renderer(),
-				path[i - 1ll]->x * cellSize + offset,
-				path[i - 1ll]->y * cellSize + offset,
-				path[i]->x * cellSize + offset,
-				path[i]->y * cellSize + offset
+				screenX(maze.x(cells[i - 1ll]) * cellSize + path.offset),
+				screenY(maze.y(cells[i - 1ll]) * cellSize + path.offset),
+				screenX(maze.x(cells[i]) * cellSize + path.offset),
+				screenY(maze.y(cells[i]) * cellSize + path.offset)
 			);
 		}
 	}
-	void clearCell(Cell* c) {
-		renderCell(c);
-		rerenderCellsAbove(c);
-	}
-	void clearPath(std::vector<Cell*>& path) {
-		for (Cell* c : path)
-			clearCell(c);
+
+	void initTextures() {
+		// pack all tiles into one atlas row
+		TileSet tiles;
+		SDL_Surface* atlasSurface = SDL_CreateRGBSurface(0, cellSize * atlasTiles, cellSize, 32, 0xff000000, 0x00ff0000, 0x0000ff00, 0x000000ff);
+		if (atlasSurface == NULL)
+			throw "unable to create surface";
+		for (int i = 0; i < atlasTiles; i++)
+			for (int y = 0; y < cellSize; y++)
+				memcpy(static_cast<Uint8*>(atlasSurface->pixels) + y * atlasSurface->pitch + i * cellSize * sizeof(Uint32), tiles.row(i, y), cellSize * sizeof(Uint32));
+		atlas = SDL_CreateTextureFromSurface(context->renderer(), atlasSurface);
+		SDL_FreeSurface(atlasSurface);
+		if (atlas == NULL)
+			throw "unable to create texture";
+		SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND);
 	}
-	void present() { SDL_RenderPresent(context->renderer()); }
 
-	size_t width() { return cellWidth; }
-	size_t height() { return cellHeight; }
-	size_t size() { return cells.size(); }
+	// adds one atlas tile at cell (x, y) to the batch for the next flushTiles()
+	void queueTile(int tile, int x, int y) {
+		// both edges come from screenX/Y so neighbouring tiles meet exactly at any zoom
+		const float left = screenX(x * cellSize), top = screenY(y * cellSize);
+		const float right = screenX((x + 1) * cellSize), bottom = screenY((y + 1) * cellSize);
+		const float u = static_cast<float>(tile) / atlasTiles, uWidth = 1.0f / atlasTiles;
+		const SDL_Color white = { 0xff, 0xff, 0xff, 0xff };
+		const int first = static_cast<int>(tileVertices.size());
+		tileVertices.push_back({ { left, top }, white, { u, 0 } });
+		tileVertices.push_back({ { right, top }, white, { u + uWidth, 0 } });
+		tileVertices.push_back({ { right, bottom }, white, { u + uWidth, 1 } });
+		tileVertices.push_back({ { left, bottom }, white, { u, 1 } });
+		for (int corner : { 0, 1, 2, 0, 2, 3 })
+			tileIndices.push_back(first + corner);
+	}
+	// the choke point marks on c, unless a bridge hides it
+	void queueOverlay(CellIndex c) {
+		if (overlayFlags.empty() || overlayFlags[c] == 0 || !isVisible(c) || maze.isCovered(c))
+			return;
+		for (int direction = 0; direction < 4; direction++) {
+			if (overlayFlags[c] & 1 << direction)
+				queueTile(chokeLinkTile + direction, maze.x(c), maze.y(c));
+		}
+		if (overlayFlags[c] & chokeCellFlag)
+			queueTile(chokeCellTile, maze.x(c), maze.y(c));
+	}
+	// draws every queued tile in a single call. Must run before any other kind of drawing so that the order is kept.
+	void flushTiles() {
+		if (tileVertices.empty())
+			return;
+		SDL_RenderGeometry(context->renderer(), atlas, tileVertices.data(), static_cast<int>(tileVertices.size()), tileIndices.data(), static_cast<int>(tileIndices.size()));
+		tileVertices.clear();
+		tileIndices.clear();
+	}
 
-	Cell* data() { return cells.data(); }
-	Cell* getStart() { return solution.empty() ? NULL : solution[0]; }
-	Cell* getFinish() { return solution.empty() ? NULL : solution[solution.size()-1]; }
+	void rerenderCellsAbove(CellIndex c) {
+		for (int z = maze.z(c) + 1; z < maze.depth(); z++) {
+			CellIndex zCell = maze.getCell(maze.x(c), maze.y(c), z);
+			if (maze.isOpen(zCell))
+				renderCell(zCell);
+		}
+	}
 
 private:
-	void initTextures() {
-		// set up textures
-		std::array<SDL_Surface*, 1 << 4> tileSurfaces;
-
-		constexpr Uint32 rmask = 0xff000000, gmask = 0x00ff0000, bmask = 0x0000ff00, amask = 0x000000ff;
-		auto makeSurf = [&]() -> SDL_Surface* {
-			SDL_Surface* surface = SDL_CreateRGBSurface(0, cellSize, cellSize, 32, rmask, gmask, bmask, amask);
-			SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
-			SDL_FillRect(surface, NULL, 0x00000000); // transparent
-			return surface;
-		};
-		auto makeTex = [&](SDL_Surface* surf) -> SDL_Texture* {
-			SDL_Texture* texture = SDL_CreateTextureFromSurface(context->renderer(), surf);
-			if (texture == NULL)
-				throw "unable to create texture";
-			SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
-			return texture;
-		};
+	Maze& maze;
+	std::unique_ptr<SDLContext> context;
 
-		{
-			SDL_Surface* endSurf = makeSurf();
-			Uint32* data = (Uint32*)endSurf->pixels;
-			for (int i = 1; i <= cellSize / 2 - 3; i++) {
-				for (int j = -i; j < i; j++) {
-					int x = cellSize / 2 + j;
-					data[x + cellSize * (i + 2)] = 0x000000ff;
-					data[x + cellSize * (cellSize - 3 - i)] = 0x000000ff;
-				}
-			}
-			endTex = makeTex(endSurf);
-		}
-		{
-			SDL_Surface* startSurf = makeSurf();
-			SDL_Rect endRect = { 3, 3, cellSize - 6, cellSize - 6 };
-			SDL_FillRect(startSurf, &endRect, 0x000000ff);
-			startTex = makeTex(startSurf);
-		}
+	// every tile lives in one atlas texture, in TileSet order
+	static constexpr int startTile = TileSet::startTile;
+	static constexpr int endTile = TileSet::endTile;
+	static constexpr int chokeLinkTile = TileSet::chokeLinkTile;
+	static constexpr int chokeCellTile = TileSet::chokeCellTile;
+	static constexpr int atlasTiles = TileSet::count;
+	SDL_Texture* atlas;
+	std::vector<SDL_Vertex> tileVertices;
+	std::vector<int> tileIndices;
+
+	// streaming target for drawTiles(), big enough for the view at lodZoom
+	SDL_Texture* frameTexture;
+	std::vector<Uint32> framePixels;
+	// zoomed out: the pyramid, and a window-sized streaming texture drawLOD() fills from it
+	LODPyramid lod;
+	SDL_Texture* lodTexture;
+	std::vector<Uint32> lodPixels;
+	std::vector<int> lodColumns;
+	std::vector<int> lodRows;
+
+	// view: maze pixel at the window's top left, and window pixels per maze pixel
+	double viewLeft = 0;
+	double viewTop = 0;
+	double zoom = 1;
+	CellRect visible;
+	bool viewMoved = false;
+
+	// what has been drawn over the cells, for redrawing
+	std::vector<std::pair<Uint32, std::vector<CellIndex>>> paths;
+	std::vector<ThinPath> thinPaths;
+	// choke point marks per cell: bits 0-3 for choke links in each direction, chokeCellFlag for a choke cell
+	static constexpr uint8_t chokeCellFlag = 1 << 4;
+	std::vector<uint8_t> overlayFlags;
+	std::vector<CellIndex> overlayCells;
+
+	// batched presentation
+	std::vector<CellIndex> dirtyCells;
+	std::vector<uint8_t> dirtyFlags;
+	std::chrono::microseconds frameInterval{ 1000000 / 60 };
+	int stepsPerFrame = 0;
+	int stepsSincePresent = 0;
+	std::chrono::steady_clock::time_point lastPresent;
+};
 
-		// empty tile texture at index 0
-		tileSurfaces[0] = makeSurf();
-		constexpr Uint32 colors[] = { 0x000000ff, 0xffffffff };
-		Uint32* data = (Uint32*)tileSurfaces[0]->pixels;
-		for (int y = 0; y < cellSize; y++)
-			for (int x = 0; x < cellSize; x++)
-				data[y * cellSize + x] = colors[(x + y) % 2];
+// Times a full-grid BFS over headless mazes of growing size.
+// Time per cell should stay flat as the grid grows if traversal is linear.
+int benchmarkTraversal() {
+	constexpr int sides[] = { 250, 500, 1000, 2000 };
+	constexpr int repeats = 5;
 
-		// maze tiles
-		for (int i = 1; i < 1 << 4; i++) {
-			SDL_Surface* surface = makeSurf();
-			tileSurfaces[i] = surface;
+	std::cout << "cells\tms/BFS\tns/cell\n";
+	for (int side : sides) {
+		Maze maze(side, side);
+		maze.generate(1.0 / 10, 1.0 / 25, 0.8, 1);
 
-			bool right = i & 1;
-			bool up = i & 2;
-			bool left = i & 4;
-			bool down = i & 8;
+		size_t visited = 0;
+		auto countVertex = [&](CellIndex c) -> void { visited++; };
 
-			Uint32 color = 0x000000ff;
-			for (int margin = 1; margin <= 2; margin++) {
-				// horizontal connections
-				int longthMargin = 2 * margin;
-				if (right)
-					longthMargin -= margin;
-				if (left)
-					longthMargin -= margin;
-				SDL_Rect rect = {
-					left ? 0 : margin,
-					margin,
-					cellSize - longthMargin,
-					cellSize - 2 * margin };
-				SDL_FillRect(surface, &rect, color);
+		auto begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < repeats; i++)
+			maze.BFS(maze.getStart(), BFSHooks{ .earlyVertex = countVertex });
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - begin;
 
-				// vertical connections
-				longthMargin = 2 * margin;
-				if (up)
-					longthMargin -= margin;
-				if (down)
-					longthMargin -= margin;
-				rect = {
-					margin,
-					up ? 0 : margin,
-					cellSize - 2 * margin,
-					cellSize - longthMargin };
-				SDL_FillRect(surface, &rect, color);
+		double msPerSearch = elapsed.count() / repeats;
+		std::cout << visited / repeats << "\t" << msPerSearch << "\t" << msPerSearch * 1e6 / (visited / repeats) << "\n";
+	}
+	return 0;
+}
 
-				color = 0xffffffff; // switch to white for second time around
-			}
+// Compares generation engines on the same grid. Dead ends and solution length give a rough idea of each texture.
+int benchmarkEngines() {
+	constexpr int side = 1000;
+
+	std::cout << "engine\tM cells/s\tcarve ms\tdead ends\tsolution\n";
+	for (GeneratorEngine engine : allEngines) {
+		Maze maze(side, side);
+		Stopwatch stopwatch;
+		maze.generate(1.0 / 10, 0, 0.8, 1, engine);
+		double ms = stopwatch.lap();
+
+		size_t open = 0, deadEnds = 0;
+		for (CellIndex c = 0; c < maze.size(); c++) {
+			if (!maze.isOpen(c))
+				continue;
+			open++;
+			if (std::popcount(maze.connections(c)) == 1)
+				deadEnds++;
 		}
+		std::cout << engineName(engine) << "\t" << side * side / ms / 1e3 << "\t" << maze.generationStats().carveMs << "\t"
+			<< 100.0 * deadEnds / open << "%\t" << maze.distance(maze.getStart(), maze.getFinish()) << "\n";
+	}
+	return 0;
+}
 
-		for (int i = 0; i < 1 << 4; i++)
-			tileTextures[i] = makeTex(tileSurfaces[i]);
+// Times point-to-point queries between random cells of a braided maze with each search strategy.
+int benchmarkPathQueries() {
+	constexpr int side = 1000;
+	constexpr int queries = 200;
+
+	Maze maze(side, side);
+	maze.generate(1.0 / 10, 1.0 / 25, 0.8, 1);
+
+	// random pairs of open ground cells
+	Random random(2);
+	std::vector<std::pair<CellIndex, CellIndex>> pairs;
+	while (pairs.size() < queries) {
+		CellIndex a = maze.getCell(random.below(side), random.below(side), 0);
+		CellIndex b = maze.getCell(random.below(side), random.below(side), 0);
+		if (maze.isOpen(a) && maze.isOpen(b))
+			pairs.push_back({ a, b });
 	}
 
-	void rerenderCellsAbove(Cell* c) {
-		for (int z = c->z + 1; z < layers; z++) {
-			Cell* zCell = getCell(c->x, c->y, z);
-			if (zCell->open)
-				renderCell(zCell);
-		}
+	auto time = [&](const char* name, auto query) {
+		size_t totalLength = 0;
+		auto begin = std::chrono::steady_clock::now();
+		for (auto& [a, b] : pairs)
+			totalLength += query(a, b);
+		std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - begin;
+		std::cout << name << "\t" << elapsed.count() / queries << "\t" << totalLength / queries << "\n";
+	};
+	std::cout << "query\tus/query\tmean length\n";
+	time("BFS", [&](CellIndex a, CellIndex b) -> size_t { return maze.distance(a, b); });
+	time("bidi", [&](CellIndex a, CellIndex b) -> size_t { return maze.shortestPath(a, b).size() - 1; });
+	time("A*", [&](CellIndex a, CellIndex b) -> size_t { return maze.aStarPath(a, b).size() - 1; });
+	return 0;
+}
+
+// Times distance queries on a maze without loops: per-query searches against a TreeDistanceOracle built once.
+int benchmarkTreeDistances() {
+	constexpr int side = 1000;
+	constexpr int searchQueries = 200;
+	constexpr int oracleQueries = 1000000;
+
+	Maze maze(side, side);
+	maze.generate(1.0 / 10, 0, 0.8, 1);
+	Stopwatch stopwatch;
+	TreeDistanceOracle oracle(maze, maze.getStart());
+	const double buildMs = stopwatch.lap();
+
+	Random random(2);
+	std::vector<std::pair<CellIndex, CellIndex>> pairs;
+	while (pairs.size() < oracleQueries) {
+		CellIndex a = maze.getCell(random.below(side), random.below(side), 0);
+		CellIndex b = maze.getCell(random.below(side), random.below(side), 0);
+		if (oracle.contains(a) && oracle.contains(b))
+			pairs.push_back({ a, b });
 	}
 
-private:
-	std::unique_ptr<SDLContext> context;
+	stopwatch.lap();
+	size_t searchTotal = 0;
+	for (int i = 0; i < searchQueries; i++)
+		searchTotal += maze.distance(pairs[i].first, pairs[i].second);
+	const double searchMs = stopwatch.lap();
+	size_t oracleTotal = 0;
+	for (auto& [a, b] : pairs)
+		oracleTotal += oracle.distance(a, b);
+	const double oracleMs = stopwatch.lap();
+
+	std::cout << "tree query\tus/query\tmean length\n";
+	std::cout << "BFS\t" << searchMs * 1e3 / searchQueries << "\t" << searchTotal / searchQueries << "\n";
+	std::cout << "oracle\t" << oracleMs * 1e3 / oracleQueries << "\t" << oracleTotal / oracleQueries << " (built in " << buildMs << " ms)\n";
+	return 0;
+}
+
+// Command-line numbers. The whole value has to parse, where stoi alone would read "12abc" as 12;
+// anything else throws std::invalid_argument, or std::out_of_range if it doesn't fit.
+int parseInt(const std::string& value) {
+	size_t used = 0;
+	int result = std::stoi(value, &used);
+	if (used != value.size())
+		throw std::invalid_argument(value);
+	return result;
+}
+double parseDouble(const std::string& value) {
+	size_t used = 0;
+	double result = std::stod(value, &used);
+	if (used != value.size())
+		throw std::invalid_argument(value);
+	return result;
+}
+// stoull would quietly wrap a negative seed around
+uint64_t parseSeed(const std::string& value) {
+	size_t used = 0;
+	uint64_t result = std::stoull(value, &used);
+	if (used != value.size() || value.find('-') != std::string::npos)
+		throw std::invalid_argument(value);
+	return result;
+}
 
-	// textures
-	std::array<SDL_Texture*, 1 << 4> tileTextures;
-	SDL_Texture* startTex;
-	SDL_Texture* endTex;
+// Generates a batch of mazes without a window and reports throughput, e.g.
+//   amazing batch --count 64 --width 1000 --height 1000 --threads 8
+// with --save, each maze is also written to <prefix><seed>.maze
+// with --tiled, each maze is carved by generateTiled() on that many threads
+// --maze-threads sets how many threads the parallel-kruskal engine uses for each maze
+int runBatch(int argc, char* args[]) {
+	int count = 16;
+	int width = 1000, height = 1000;
+	int threadCount = 1;
+	double branchChance = 1.0 / 10, loopChance = 0, bridgeChance = 0.8;
+	uint64_t seed = static_cast<uint64_t>(time(NULL));
+	std::string savePrefix;
+	int tileThreads = 0;
+	int mazeThreads = 1;
+	int layers = Maze::defaultLayers;
+	GeneratorEngine engine = GeneratorEngine::growingTree;
+	EndpointPlacement endpoints = EndpointPlacement::diameterSearch;
+	int slack = 0;
+
+	auto usage = [](const std::string& problem) {
+		std::cerr << problem << "\n"
+			<< "usage: amazing batch [--count n] [--width cells] [--height cells] [--threads n]\n"
+			<< "                     [--branch p] [--loop p] [--bridge p] [--seed n] [--save prefix] [--tiled threads]\n"
+			<< "                     [--engine growing|wilson|kruskal|parallel-kruskal] [--maze-threads n] [--layers 1|2]\n"
+			<< "                     [--endpoints search|track|bound] [--slack steps]\n"
+			<< "  --endpoints bound finds the exact diameter even with loops, but braided mazes take tens of full searches\n"
+			<< "  instead of search's two; --slack n accepts a path up to n steps short for fewer\n";
+		return 1;
+	};
 
-	// maze data
-	static constexpr size_t layers = 2;
-	size_t cellWidth, cellHeight;
-	std::vector<Cell> cells;
+	for (int i = 0; i < argc; i++) {
+		std::string option = args[i];
+		if (i + 1 >= argc)
+			return usage("missing value for " + option);
+		std::string value = args[++i];
+		try {
+			if (option == "--count")
+				count = parseInt(value);
+			else if (option == "--width")
+				width = parseInt(value);
+			else if (option == "--height")
+				height = parseInt(value);
+			else if (option == "--threads")
+				threadCount = parseInt(value);
+			else if (option == "--branch")
+				branchChance = parseDouble(value);
+			else if (option == "--loop")
+				loopChance = parseDouble(value);
+			else if (option == "--bridge")
+				bridgeChance = parseDouble(value);
+			else if (option == "--seed")
+				seed = parseSeed(value);
+			else if (option == "--save")
+				savePrefix = value;
+			else if (option == "--tiled")
+				tileThreads = std::max(1, parseInt(value));
+			else if (option == "--engine")
+				engine = parseEngine(value);
+			else if (option == "--maze-threads")
+				mazeThreads = std::max(1, parseInt(value));
+			else if (option == "--layers")
+				layers = parseInt(value);
+			else if (option == "--endpoints")
+				endpoints = parseEndpoints(value);
+			else if (option == "--slack")
+				slack = parseInt(value);
+			else
+				return usage("unknown option " + option);
+		} catch (const std::invalid_argument&) {
+			return usage("bad value for " + option + ": " + value);
+		} catch (const std::out_of_range&) {
+			return usage("value out of range for " + option + ": " + value);
+		}
+	}
+	if (count < 1 || width < 1 || height < 1 || threadCount < 1)
+		return usage("count, width, height and threads must be at least 1");
+	if (layers < 1 || layers > Maze::maxLayers)
+		return usage("layers must be 1 (no bridges) or 2");
+	// the workers build the mazes, and a throw on their threads would end the process
+	if (const char* problem = Maze::sizeProblem(width, height, layers))
+		return usage(problem);
+
+	// maze i always uses seed + i, regardless of which thread picks it up
+	std::atomic<int> nextMaze = 0;
+	std::mutex totalsMutex;
+	GenerationStats totals;
+	auto worker = [&]() {
+		GenerationStats sum;
+		for (int i = nextMaze++; i < count; i = nextMaze++) {
+			Maze maze(width, height, layers);
+			maze.setEndpointPlacement(endpoints, slack);
+			if (tileThreads > 0)
+				maze.generateTiled(branchChance, loopChance, bridgeChance, seed + i, tileThreads);
+			else
+				maze.generate(branchChance, loopChance, bridgeChance, seed + i, engine, mazeThreads);
+			if (!savePrefix.empty())
+				maze.save(savePrefix + std::to_string(seed + i) + ".maze");
+			const GenerationStats& stats = maze.generationStats();
+			sum.carveMs += stats.carveMs;
+			sum.diameterMs += stats.diameterMs;
+			sum.solutionMs += stats.solutionMs;
+			sum.diameterSearches += stats.diameterSearches;
+			sum.diameterGap = std::max(sum.diameterGap, stats.diameterGap);
+		}
+		std::lock_guard<std::mutex> lock(totalsMutex);
+		totals.carveMs += sum.carveMs;
+		totals.diameterMs += sum.diameterMs;
+		totals.solutionMs += sum.solutionMs;
+		totals.diameterSearches += sum.diameterSearches;
+		totals.diameterGap = std::max(totals.diameterGap, sum.diameterGap);
+	};
 
-	std::vector<Cell*> solution;
-};
+	auto begin = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threadCount; t++)
+		workers.emplace_back(worker);
+	for (std::thread& t : workers)
+		t.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+	double seconds = elapsed.count();
+	double cells = static_cast<double>(width) * height * count;
+	std::cout << "generated " << count << " mazes of " << width << "x" << height << " (seeds " << seed << "..) on "
+		<< threadCount << " thread(s) in " << seconds << " s\n";
+	std::cout << "  " << count / seconds << " mazes/s, " << cells / seconds / 1e6 << " M cells/s\n";
+	std::cout << "  per maze: carve " << totals.carveMs / count << " ms, diameter BFS " << totals.diameterMs / count
+		<< " ms, solution " << totals.solutionMs / count << " ms\n";
+	std::cout << "  " << static_cast<double>(totals.diameterSearches) / count << " searches per maze";
+	if (totals.diameterGap >= 0)
+		std::cout << ", solutions at most " << totals.diameterGap << " steps short of the diameter";
+	std::cout << "\n";
+	return 0;
+}
+
+// amazing export <image.png|image.ppm> [options]: writes a maze to an image without opening a window
+int runExport(int argc, char* args[]) {
+	auto usage = [](const std::string& problem) {
+		std::cerr << problem << "\n"
+			<< "usage: amazing export <image.png|image.ppm> [--maze file] [--width cells] [--height cells] [--seed n]\n"
+			<< "                      [--branch p] [--loop p] [--bridge p] [--engine name] [--layers 1|2] [--solution]\n";
+		return 1;
+	};
+	if (argc < 1)
+		return usage("no image path");
+	std::string imagePath = args[0];
+	std::string mazePath;
+	int width = 100, height = 100;
+	double branchChance = 1.0 / 10, loopChance = 0, bridgeChance = 0.8;
+	uint64_t seed = static_cast<uint64_t>(time(NULL));
+	int layers = Maze::defaultLayers;
+	GeneratorEngine engine = GeneratorEngine::growingTree;
+	bool withSolution = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string option = args[i];
+		if (option == "--solution") {
+			withSolution = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+			return usage("missing value for " + option);
+		std::string value = args[++i];
+		try {
+			if (option == "--maze")
+				mazePath = value;
+			else if (option == "--width")
+				width = parseInt(value);
+			else if (option == "--height")
+				height = parseInt(value);
+			else if (option == "--branch")
+				branchChance = parseDouble(value);
+			else if (option == "--loop")
+				loopChance = parseDouble(value);
+			else if (option == "--bridge")
+				bridgeChance = parseDouble(value);
+			else if (option == "--seed")
+				seed = parseSeed(value);
+			else if (option == "--engine")
+				engine = parseEngine(value);
+			else if (option == "--layers")
+				layers = parseInt(value);
+			else
+				return usage("unknown option " + option);
+		} catch (const std::invalid_argument&) {
+			return usage("bad value for " + option + ": " + value);
+		} catch (const std::out_of_range&) {
+			return usage("value out of range for " + option + ": " + value);
+		}
+	}
+	if (width < 1 || height < 1)
+		return usage("width and height must be at least 1");
+	if (layers < 1 || layers > Maze::maxLayers)
+		return usage("layers must be 1 (no bridges) or 2");
+
+	std::unique_ptr<Maze> maze;
+	if (!mazePath.empty()) {
+		maze = Maze::load(mazePath);
+	} else {
+		maze = std::make_unique<Maze>(width, height, layers);
+		maze->generate(branchChance, loopChance, bridgeChance, seed, engine);
+	}
+
+	Stopwatch stopwatch;
+	exportImage(*maze, imagePath, withSolution);
+	std::cout << "wrote " << imagePath << ": " << maze->width() * TileSet::cellSize << "x" << maze->height() * TileSet::cellSize
+		<< " pixels in " << stopwatch.lap() << " ms\n";
+	return 0;
+}
 
 int main(int argc, char* args[]) {
-	srand(static_cast<unsigned int>(time(NULL)));
+	if (argc > 1 && std::string(args[1]) == "bench")
+		return benchmarkTraversal() || benchmarkPathQueries() || benchmarkTreeDistances() || benchmarkEngines();
+	if (argc > 1 && std::string(args[1]) == "batch")
+		return runBatch(argc - 2, args + 2);
+	if (argc > 1 && std::string(args[1]) == "export")
+		return runExport(argc - 2, args + 2);
+
+	// argument is either a maze file to play or a seed to generate from, optionally followed by the maze size in cells.
+	// Mazes bigger than the window can be dragged around and zoomed with the mouse.
+	std::string argument = argc > 1 ? args[1] : "";
+	std::unique_ptr<Maze> maze;
+	std::unique_ptr<MazeRenderer> renderer;
+	if (argument.ends_with(".maze")) {
+		maze = Maze::load(argument);
+		renderer = std::make_unique<MazeRenderer>(*maze);
+		renderer->renderAll();
+	} else {
+		int width = MazeRenderer::cellsForScreen(MazeRenderer::maxScreenWidth);
+		int height = MazeRenderer::cellsForScreen(MazeRenderer::maxScreenHeight);
+		uint64_t seed = static_cast<uint64_t>(time(NULL));
+		try {
+			if (argc > 1)
+				seed = parseSeed(argument);
+			if (argc > 3) {
+				width = parseInt(args[2]);
+				height = parseInt(args[3]);
+			}
+		} catch (const std::logic_error&) {
+			std::cerr << "usage: amazing [seed [width height] | file.maze] | amazing batch ... | amazing export ...\n";
+			return 1;
+		}
+		maze = std::make_unique<Maze>(width, height);
+		renderer = std::make_unique<MazeRenderer>(*maze);
+		maze->setObserver(renderer.get());
+
+		constexpr double branchChance = 1.0 / 10;
+		constexpr double loopChance = 0; // 1.0 / 25;
+		constexpr double bridgeChance = 0.8;
+		std::cout << "seed " << seed << "\n";
+		maze->generate(branchChance, loopChance, bridgeChance, seed);
+	}
+
 	bool running = true;
 
 	auto waitKeyCheckQuit = [&]() -> SDL_Keycode {
 		SDL_Event e;
 		do {
-			SDL_WaitEvent(&e);
+			if (!SDL_PollEvent(&e)) {
+				// caught up with input - show where the view has been moved to before sleeping
+				renderer->updateView();
+				SDL_WaitEvent(&e);
+			}
 			if (e.type == SDL_QUIT)
 				running = false;
 			else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)
 				running = false;
+			else
+				renderer->handleEvent(e);
 		} while (e.type != SDL_KEYDOWN);
 		return e.key.keysym.sym;
 	};
 
-	auto maze = std::make_unique<Maze>(2000, 1200);
-
-	constexpr double branchChance = 1.0 / 10;
-	constexpr double loopChance = 0; // 1.0 / 25;
-	constexpr double bridgeChance = 0.8;
-	maze->generate(branchChance, loopChance, bridgeChance);
-
 	// let's look for cycles and highlight them
 	// this won't highlight every possible cycle, but if all highlighted cycles are broken then all possible cycles will also be broken.
-	Cell* start = maze->getStart();
-	if (start == NULL) {
+	CellIndex start = maze->getStart();
+	if (start == noCell) {
 		std::cerr << "no starting point?";
 		return 1;
 	}
 
-	bool foundloop = false;
-	std::vector<Cell*> loop;
 	constexpr int paletteSize = 5;
 	constexpr Uint32 palette[paletteSize] = { 0xa24a7cff, 0xfb8891ff, 0xffc094ff, 0x92ddc8ff, 0x65b2bcff };
 	int loopCounter = 0;
-
-	std::vector<Cell*> prevLinks(maze->size(), NULL);
-	std::vector<int> distances(maze->size(), 0);
-	auto getIndex = [&](Cell* c) -> size_t { return c - maze->data(); };
-	std::function<void(Cell*, Cell*)> prevLinkEdge = [&](Cell* p, Cell* c) -> void {
-		//if (foundloop)
-		//	return; // don't look further
-		if (prevLinks[getIndex(p)] == c)
-			return; // it's the path back where we came from
-
-		if (c->state == TraversalState::discovered)
-			return;
-		if (c->state == TraversalState::processed) {
-			foundloop = true;
-			loop.clear();
-			std::vector<Cell*> pairPath;
-
-			// handle unequal path lengths back to common vertex
-			int pDist = distances[getIndex(p)];
-			int cDist = distances[getIndex(c)];
-			if (cDist > pDist) {
-				pairPath.push_back(c);
-				c = prevLinks[getIndex(c)];
-				cDist--;
-			}
-			if (cDist < pDist) {
-				loop.push_back(p);
-				p = prevLinks[getIndex(p)];
-				pDist--;
-			}
-
-			do {
-				loop.push_back(p);
-				pairPath.push_back(c);
-				p = prevLinks[getIndex(p)];
-				c = prevLinks[getIndex(c)];
-			} while (p != c);
-			loop.push_back(p);
-			while (!pairPath.empty()) {
-				loop.push_back(pairPath.back());
-				pairPath.pop_back();
-			}
-			loop.push_back(loop.front());
-
-			maze->renderThinPath(loop, palette[loopCounter%paletteSize]);
-			maze->present();
-			loopCounter++;
-			return;
-		}
-		size_t index = getIndex(c);
-		prevLinks[index] = p;
-		distances[index] = distances[getIndex(p)] + 1;
-	};
-	std::function<void(Cell*)> nopVertex = [&](Cell* c) -> void {};
-	maze->BFS(start, nopVertex, nopVertex, prevLinkEdge);
+	maze->forEachCycle(start, [&](const std::vector<CellIndex>& loop) {
+		renderer->renderThinPath(loop, palette[loopCounter % paletteSize]);
+		renderer->stepFinished(); // shown a frame at a time, not one present per loop
+		loopCounter++;
+	});
+	renderer->present();
+
+	// with loops, mark the cells and links every route between their two sides has to go through
+	// (in a tree that would be every corridor)
+	if (loopCounter > 0)
+		renderer->renderChokePoints(maze->findChokePoints(start));
+	// without loops, the players' distance can be looked up instead of searched for after every move
+	std::unique_ptr<TreeDistanceOracle> treeDistances;
+	if (loopCounter == 0)
+		treeDistances = std::make_unique<TreeDistanceOracle>(*maze, start);
 
 	// let's do a two player maze solving game
 	// the players will try to find a path to each other
@@ -629,7 +3295,7 @@ int main(int argc, char* args[]) {
 		return -1;
 	};
 
-	std::array<std::vector<Cell*>, 2> playerPaths;
+	std::array<std::vector<CellIndex>, 2> playerPaths;
 	playerPaths[0].push_back(maze->getStart());
 	playerPaths[1].push_back(maze->getFinish());
 
@@ -638,17 +3304,24 @@ int main(int argc, char* args[]) {
 			std::find(playerPaths[1].begin(), playerPaths[1].end(), playerPaths[0].back()) != playerPaths[1].end();
 	};
 
+	auto showDistance = [&]() {
+		CellIndex a = playerPaths[0].back(), b = playerPaths[1].back();
+		size_t steps = treeDistances ? treeDistances->distance(a, b) : maze->shortestPath(a, b).size() - 1;
+		renderer->setTitle("Maze - players are " + std::to_string(steps) + " steps apart");
+	};
+	showDistance();
+
 	bool won = false;
 	while (running && !won) {
 		const SDL_Keycode key = waitKeyCheckQuit();
 
 		for (int player = 0; player < 2; player++) {
-			std::vector<Cell*>& path = playerPaths[player];
+			std::vector<CellIndex>& path = playerPaths[player];
 
 			auto backtrack = [&]() {
-				maze->clearCell(path.back());
+				renderer->clearCell(path.back());
 				path.pop_back();
-				maze->clearCell(path.back());
+				renderer->clearCell(path.back());
 			};
 
 			int direction = getDirection(player, key);
@@ -657,18 +3330,19 @@ int main(int argc, char* args[]) {
 			if (direction == 4) {
 				backtrack();
 			} else {
-				Cell* last = path.back();
-				if (!last->connections[direction])
+				CellIndex last = path.back();
+				if (!maze->isConnected(last, direction))
 					break;
-				Cell* next = maze->getNeighbor(last, direction, last->verticalConnections[direction]);
+				CellIndex next = maze->follow(last, direction);
 				if (path.size() > 1 && next == path[path.size() - 2])
 					backtrack();
 				else
 					path.push_back(next);
 				won = checkWin();
 			}
-			maze->renderPath(path, playerColors[player]);
-			maze->present();
+			renderer->renderPath(path, playerColors[player]);
+			renderer->present();
+			showDistance();
 		}
 	}
 